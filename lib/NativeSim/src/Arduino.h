@@ -0,0 +1,99 @@
+#ifndef NATIVESIM_ARDUINO_H
+#define NATIVESIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/*
+ * The part of the Arduino core used by the firmware, backed by the simulator of NativeSim.h. Pins are numbered
+ * as on ATmega8 / ATmega328P boards: D0-D7 on port D, D8-D13 on port B, A0-A5 on port C.
+ */
+
+#define F_CPU 16000000UL
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+
+#define NUM_DIGITAL_PINS 20
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+#define SERIAL_RX_BUFFER_SIZE 64
+#define SERIAL_TX_BUFFER_SIZE 64
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+class Stream {
+public:
+    virtual ~Stream() = default;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(uint8_t byte) = 0;
+    size_t write(const uint8_t *buffer, size_t size) {
+        size_t written = 0;
+        while (size--) {
+            written += write(*buffer++);
+        }
+        return written;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        size_t count = 0;
+        while (count < length && available() > 0) {
+            buffer[count++] = (uint8_t) read();
+        }
+        return count;
+    }
+};
+
+// UART with the ring buffer sizes of the Arduino core, bytes move on the wire at the configured baud rate
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available() override;
+    int read() override;
+    int peek() override;
+    int availableForWrite();
+    using Stream::write;
+    size_t write(uint8_t byte) override;
+    void flush();
+    explicit operator bool() {
+        return true;
+    }
+};
+
+extern HardwareSerial Serial;
+
+#endif //NATIVESIM_ARDUINO_H
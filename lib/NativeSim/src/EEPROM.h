@@ -0,0 +1,36 @@
+#ifndef NATIVESIM_EEPROM_H
+#define NATIVESIM_EEPROM_H
+
+#include <avr/eeprom.h>
+#include <avr/io.h>
+
+// the Arduino EEPROM library interface on top of the simulated avr-libc functions
+class EEPROMClass {
+public:
+    uint8_t read(int idx) {
+        return eeprom_read_byte((const uint8_t *) (size_t) idx);
+    }
+    void write(int idx, uint8_t value) {
+        eeprom_write_byte((uint8_t *) (size_t) idx, value);
+    }
+    void update(int idx, uint8_t value) {
+        eeprom_update_byte((uint8_t *) (size_t) idx, value);
+    }
+    uint16_t length() {
+        return E2END + 1;
+    }
+    template<typename T>
+    T &get(int idx, T &t) {
+        eeprom_read_block(&t, (const void *) (size_t) idx, sizeof(T));
+        return t;
+    }
+    template<typename T>
+    const T &put(int idx, const T &t) {
+        eeprom_update_block(&t, (void *) (size_t) idx, sizeof(T));
+        return t;
+    }
+};
+
+static EEPROMClass EEPROM;
+
+#endif //NATIVESIM_EEPROM_H
@@ -0,0 +1,45 @@
+#ifndef NATIVESIM_NATIVEHAL_H
+#define NATIVESIM_NATIVEHAL_H
+
+#include <avr/eeprom.h>
+#include "NativeSim.h"
+
+// Hal.h functions of the native env, interrupt handlers are called synchronously so the lock has nothing to do
+
+class InterruptLock {
+public:
+    InterruptLock() {}
+    ~InterruptLock() {}
+};
+
+template<uint8_t PORT_IDX>
+inline volatile uint8_t &halOutputPort() {
+    return NativeSim::outputPort(PORT_IDX);
+}
+
+inline void halReadPorts(uint8_t ports[PORTS_COUNT]) {
+    for (uint8_t i = 0; i < PORTS_COUNT; i++) {
+        ports[i] = NativeSim::readPort(i);
+    }
+}
+
+inline void halWritePorts(const uint8_t lowMasks[PORTS_COUNT], const uint8_t highMasks[PORTS_COUNT]) {
+    for (uint8_t i = 0; i < PORTS_COUNT; i++) {
+        volatile uint8_t &port = NativeSim::outputPort(i);
+        port = (port & ~lowMasks[i]) | highMasks[i];
+    }
+}
+
+inline void halEnablePinChangeInterrupts(const uint8_t masks[PORTS_COUNT]) {
+    NativeSim::enablePinChangeInterrupts(masks);
+}
+
+inline bool halIsEepromReady() {
+    return NativeSim::isEepromReady();
+}
+
+inline void halIdleSleep() {
+    NativeSim::idleSleep();
+}
+
+#endif //NATIVESIM_NATIVEHAL_H
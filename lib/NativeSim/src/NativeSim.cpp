@@ -0,0 +1,536 @@
+#include <stdio.h>
+#include <deque>
+#include "Arduino.h"
+#include <avr/eeprom.h>
+#include "NativeSim.h"
+
+extern "C" void native_pcint0_vect(void) __attribute__((weak));
+extern "C" void native_pcint1_vect(void) __attribute__((weak));
+extern "C" void native_pcint2_vect(void) __attribute__((weak));
+
+HardwareSerial Serial;
+
+#define PORT_B 0
+#define PORT_C 1
+#define PORT_D 2
+#define TIMER0_OVERFLOW_MICROS 1024
+#define EEPROM_SIZE (E2END + 1)
+//CPU time of one polling call into the core, so busy-wait loops see the clock, UART and pins moving
+#define CORE_CALL_MICROS 1
+
+namespace {
+
+struct PinChange {
+    uint64_t time;
+    bool high;
+};
+
+struct Connection {
+    uint8_t outputPin;
+    uint8_t inputPin;
+    uint32_t delayMicros;
+    bool inversed;
+    bool lastOutput;
+    std::deque<PinChange> pending;
+};
+
+uint64_t now;
+bool advancing;
+
+volatile uint8_t ports[NATIVE_SIM_PORTS_COUNT];
+uint8_t ddrs[NATIVE_SIM_PORTS_COUNT];
+uint8_t drivenMasks[NATIVE_SIM_PORTS_COUNT];
+uint8_t drivenLevels[NATIVE_SIM_PORTS_COUNT];
+uint8_t lastPins[NATIVE_SIM_PORTS_COUNT];
+uint8_t pinChangeMasks[NATIVE_SIM_PORTS_COUNT];
+std::vector<Connection> connections;
+
+uint32_t baudRate;
+uint32_t byteMicros;
+std::deque<uint8_t> wire;
+uint64_t wireNext;
+std::deque<uint8_t> rxRing;
+std::deque<uint8_t> txRing;
+uint64_t txNext;
+std::vector<uint8_t> received;
+
+uint8_t eeprom[EEPROM_SIZE];
+uint32_t eepromWrites[EEPROM_SIZE];
+FILE *eepromFile;
+uint64_t eepromBusyUntil;
+bool powerLossArmed;
+uint32_t powerLossRemaining;
+bool powerLost;
+
+NativeSimStats simStats;
+
+inline uint8_t pinPort(uint8_t pin) {
+    return pin < 8 ? PORT_D : (pin < 14 ? PORT_B : PORT_C);
+}
+
+inline uint8_t pinMask(uint8_t pin) {
+    return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+}
+
+void callPinChangeHandler(uint8_t portIdx) {
+    void (*handler)() = portIdx == PORT_B ? native_pcint0_vect
+            : (portIdx == PORT_C ? native_pcint1_vect : native_pcint2_vect);
+    if (handler != nullptr) {
+        simStats.pinChangeInterrupts++;
+        handler();
+    }
+}
+
+void checkPinChanges() {
+    for (uint8_t i = 0; i < NATIVE_SIM_PORTS_COUNT; i++) {
+        uint8_t pins = NativeSim::readPort(i);
+        uint8_t changed = (pins ^ lastPins[i]) & pinChangeMasks[i];
+        lastPins[i] = pins;
+        if (changed) {
+            callPinChangeHandler(i);
+        }
+    }
+}
+
+void drive(uint8_t pin, bool high) {
+    uint8_t portIdx = pinPort(pin);
+    uint8_t mask = pinMask(pin);
+    drivenMasks[portIdx] |= mask;
+    drivenLevels[portIdx] = high ? drivenLevels[portIdx] | mask : drivenLevels[portIdx] & ~mask;
+    checkPinChanges();
+}
+
+// output changes are noticed at the next time step and delivered to the connected inputs after their delay
+void pollConnections() {
+    for (Connection &connection : connections) {
+        bool output = NativeSim::readPin(connection.outputPin);
+        if (output != connection.lastOutput) {
+            connection.lastOutput = output;
+            connection.pending.push_back({now + connection.delayMicros, output != connection.inversed});
+        }
+    }
+}
+
+uint64_t nextEventTime(uint64_t limit) {
+    uint64_t next = limit;
+    if (!wire.empty() && wireNext < next) {
+        next = wireNext;
+    }
+    if (!txRing.empty() && txNext < next) {
+        next = txNext;
+    }
+    for (Connection &connection : connections) {
+        if (!connection.pending.empty() && connection.pending.front().time < next) {
+            next = connection.pending.front().time;
+        }
+    }
+    return next;
+}
+
+void processDueEvents() {
+    while (!wire.empty() && wireNext <= now) {
+        if (rxRing.size() < SERIAL_RX_BUFFER_SIZE - 1) {
+            rxRing.push_back(wire.front());
+        } else {
+            simStats.rxOverruns++;
+        }
+        wire.pop_front();
+        wireNext += byteMicros;
+    }
+    while (!txRing.empty() && txNext <= now) {
+        received.push_back(txRing.front());
+        txRing.pop_front();
+        txNext += byteMicros;
+    }
+    for (Connection &connection : connections) {
+        while (!connection.pending.empty() && connection.pending.front().time <= now) {
+            drive(connection.inputPin, connection.pending.front().high);
+            connection.pending.pop_front();
+        }
+    }
+}
+
+//handlers called while the clock advances do not move it again
+void coreCall() {
+    if (!advancing) {
+        NativeSim::advanceMicros(CORE_CALL_MICROS);
+    }
+}
+
+void waitEepromReady() {
+    if (now < eepromBusyUntil) {
+        NativeSim::advanceMicros((uint32_t) (eepromBusyUntil - now));
+    }
+}
+
+void writeEeprom(uint16_t address, uint8_t value) {
+    if (address >= EEPROM_SIZE) {
+        return;
+    }
+    waitEepromReady();
+    if (powerLossArmed && !powerLost) {
+        if (powerLossRemaining == 0) {
+            powerLost = true;
+        } else {
+            powerLossRemaining--;
+        }
+    }
+    if (powerLost) {
+        simStats.eepromLostWrites++;
+        return;
+    }
+    eeprom[address] = value;
+    eepromWrites[address]++;
+    simStats.eepromWrites++;
+    eepromBusyUntil = now + NATIVE_SIM_EEPROM_WRITE_MICROS;
+    if (eepromFile != nullptr) {
+        fseek(eepromFile, address, SEEK_SET);
+        fputc(value, eepromFile);
+        fflush(eepromFile);
+    }
+}
+
+}
+
+void NativeSim::reset() {
+    detachEepromFile();
+    now = 0;
+    advancing = false;
+    for (uint8_t i = 0; i < NATIVE_SIM_PORTS_COUNT; i++) {
+        ports[i] = 0;
+        ddrs[i] = 0;
+        drivenMasks[i] = 0;
+        drivenLevels[i] = 0;
+        lastPins[i] = 0;
+        pinChangeMasks[i] = 0;
+    }
+    connections.clear();
+    baudRate = 9600;
+    byteMicros = 10 * 1000000UL / baudRate;
+    wire.clear();
+    rxRing.clear();
+    txRing.clear();
+    received.clear();
+    memset(eeprom, 0xff, sizeof(eeprom));
+    memset(eepromWrites, 0, sizeof(eepromWrites));
+    eepromBusyUntil = 0;
+    powerLossArmed = false;
+    powerLost = false;
+    simStats = NativeSimStats();
+}
+
+uint32_t NativeSim::nowMicros() {
+    return (uint32_t) now;
+}
+
+void NativeSim::advanceMicros(uint32_t micros) {
+    uint64_t target = now + micros;
+    advancing = true;
+    while (true) {
+        pollConnections();
+        processDueEvents();
+        uint64_t next = nextEventTime(target);
+        if (next <= now && now >= target) {
+            break;
+        }
+        now = next > now ? next : now;
+    }
+    advancing = false;
+}
+
+void NativeSim::setInput(uint8_t pin, bool high) {
+    drive(pin, high);
+}
+
+void NativeSim::releaseInput(uint8_t pin) {
+    drivenMasks[pinPort(pin)] &= ~pinMask(pin);
+    checkPinChanges();
+}
+
+void NativeSim::connect(uint8_t outputPin, uint8_t inputPin, uint32_t delayMicros, bool inversed) {
+    Connection connection;
+    connection.outputPin = outputPin;
+    connection.inputPin = inputPin;
+    connection.delayMicros = delayMicros;
+    connection.inversed = inversed;
+    connection.lastOutput = readPin(outputPin);
+    connections.push_back(connection);
+    drive(inputPin, connection.lastOutput != inversed);
+}
+
+void NativeSim::disconnect(uint8_t inputPin) {
+    for (auto it = connections.begin(); it != connections.end();) {
+        it = it->inputPin == inputPin ? connections.erase(it) : it + 1;
+    }
+}
+
+bool NativeSim::getOutput(uint8_t pin) {
+    return ports[pinPort(pin)] & pinMask(pin);
+}
+
+bool NativeSim::isOutput(uint8_t pin) {
+    return ddrs[pinPort(pin)] & pinMask(pin);
+}
+
+bool NativeSim::readPin(uint8_t pin) {
+    return readPort(pinPort(pin)) & pinMask(pin);
+}
+
+void NativeSim::serialSend(const uint8_t *data, size_t size) {
+    if (wire.empty()) {
+        wireNext = now + byteMicros;
+    }
+    wire.insert(wire.end(), data, data + size);
+}
+
+bool NativeSim::isSerialIdle() {
+    return wire.empty() && rxRing.empty() && txRing.empty();
+}
+
+std::vector<uint8_t> &NativeSim::serialReceived() {
+    return received;
+}
+
+uint32_t NativeSim::getBaudRate() {
+    return baudRate;
+}
+
+bool NativeSim::attachEepromFile(const char *path) {
+    detachEepromFile();
+    eepromFile = fopen(path, "r+b");
+    if (eepromFile != nullptr) {
+        size_t read = fread(eeprom, 1, EEPROM_SIZE, eepromFile);
+        memset(eeprom + read, 0xff, EEPROM_SIZE - read);
+    } else {
+        eepromFile = fopen(path, "w+b");
+        if (eepromFile == nullptr) {
+            return false;
+        }
+    }
+    fseek(eepromFile, 0, SEEK_SET);
+    fwrite(eeprom, 1, EEPROM_SIZE, eepromFile);
+    fflush(eepromFile);
+    return true;
+}
+
+void NativeSim::detachEepromFile() {
+    if (eepromFile != nullptr) {
+        fclose(eepromFile);
+        eepromFile = nullptr;
+    }
+}
+
+uint8_t *NativeSim::eepromData() {
+    return eeprom;
+}
+
+uint32_t NativeSim::eepromCellWrites(uint16_t address) {
+    return address < EEPROM_SIZE ? eepromWrites[address] : 0;
+}
+
+uint32_t NativeSim::eepromMaxCellWrites() {
+    uint32_t max = 0;
+    for (uint32_t writes : eepromWrites) {
+        max = writes > max ? writes : max;
+    }
+    return max;
+}
+
+void NativeSim::powerLossAfterWrites(uint32_t writes) {
+    powerLossArmed = true;
+    powerLossRemaining = writes;
+    powerLost = false;
+}
+
+bool NativeSim::isPowerLost() {
+    return powerLost;
+}
+
+const NativeSimStats &NativeSim::stats() {
+    return simStats;
+}
+
+volatile uint8_t &NativeSim::outputPort(uint8_t portIdx) {
+    return ports[portIdx];
+}
+
+uint8_t NativeSim::readPort(uint8_t portIdx) {
+    uint8_t ddr = ddrs[portIdx];
+    uint8_t port = ports[portIdx];
+    uint8_t driven = drivenMasks[portIdx];
+    uint8_t inputs = (driven & drivenLevels[portIdx]) | (~driven & port);
+    return (port & ddr) | (inputs & ~ddr);
+}
+
+void NativeSim::enablePinChangeInterrupts(const uint8_t masks[NATIVE_SIM_PORTS_COUNT]) {
+    for (uint8_t i = 0; i < NATIVE_SIM_PORTS_COUNT; i++) {
+        pinChangeMasks[i] = masks[i];
+        lastPins[i] = readPort(i);
+    }
+}
+
+bool NativeSim::isEepromReady() {
+    return now >= eepromBusyUntil;
+}
+
+// the CPU wakes up on the next Timer0 overflow or earlier on any UART or pin change event
+void NativeSim::idleSleep() {
+    simStats.sleeps++;
+    pollConnections();
+    uint64_t tick = (now / TIMER0_OVERFLOW_MICROS + 1) * TIMER0_OVERFLOW_MICROS;
+    uint64_t wake = nextEventTime(tick);
+    advanceMicros((uint32_t) (wake > now ? wake - now : 0));
+}
+
+uint8_t nativeReadPinRegister(uint8_t portIdx) {
+    return NativeSim::readPort(portIdx);
+}
+
+uint32_t millis() {
+    coreCall();
+    return (uint32_t) (now / 1000);
+}
+
+uint32_t micros() {
+    coreCall();
+    return (uint32_t) now;
+}
+
+void delay(uint32_t ms) {
+    NativeSim::advanceMillis(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+    NativeSim::advanceMicros(us);
+}
+
+uint8_t digitalPinToPort(uint8_t pin) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return NOT_A_PORT;
+    }
+    return pin < 8 ? PD : (pin < 14 ? PB : PC);
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+    return pin < NUM_DIGITAL_PINS ? pinMask(pin) : 0;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    uint8_t portIdx = pinPort(pin);
+    uint8_t mask = pinMask(pin);
+    if (mode == OUTPUT) {
+        ddrs[portIdx] |= mask;
+    } else {
+        ddrs[portIdx] &= ~mask;
+        ports[portIdx] = mode == INPUT_PULLUP ? ports[portIdx] | mask : ports[portIdx] & ~mask;
+    }
+    checkPinChanges();
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin >= NUM_DIGITAL_PINS) {
+        return;
+    }
+    uint8_t portIdx = pinPort(pin);
+    uint8_t mask = pinMask(pin);
+    ports[portIdx] = value == LOW ? ports[portIdx] & ~mask : ports[portIdx] | mask;
+    checkPinChanges();
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < NUM_DIGITAL_PINS && NativeSim::readPin(pin) ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) {
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, value >= 128 ? HIGH : LOW);
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    baudRate = baud;
+    byteMicros = 10 * 1000000UL / baud;
+}
+
+int HardwareSerial::available() {
+    coreCall();
+    return (int) rxRing.size();
+}
+
+int HardwareSerial::read() {
+    if (rxRing.empty()) {
+        return -1;
+    }
+    uint8_t byte = rxRing.front();
+    rxRing.pop_front();
+    return byte;
+}
+
+int HardwareSerial::peek() {
+    return rxRing.empty() ? -1 : rxRing.front();
+}
+
+int HardwareSerial::availableForWrite() {
+    coreCall();
+    return (int) (SERIAL_TX_BUFFER_SIZE - 1 - txRing.size());
+}
+
+// like the Arduino core the call blocks while the TX ring is full
+size_t HardwareSerial::write(uint8_t byte) {
+    while (txRing.size() >= SERIAL_TX_BUFFER_SIZE - 1) {
+        uint64_t start = now;
+        NativeSim::advanceMicros((uint32_t) (txNext - now));
+        simStats.txBlockedMicros += (uint32_t) (now - start);
+    }
+    if (txRing.empty()) {
+        txNext = now + byteMicros;
+    }
+    txRing.push_back(byte);
+    return 1;
+}
+
+void HardwareSerial::flush() {
+    while (!txRing.empty()) {
+        NativeSim::advanceMicros((uint32_t) (txNext - now));
+    }
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address) {
+    waitEepromReady();
+    size_t idx = (size_t) address;
+    return idx < EEPROM_SIZE ? eeprom[idx] : 0xff;
+}
+
+void eeprom_write_byte(uint8_t *address, uint8_t value) {
+    writeEeprom((uint16_t) (size_t) address, value);
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value) {
+    if (eeprom_read_byte(address) != value) {
+        eeprom_write_byte(address, value);
+    }
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        ((uint8_t *) dst)[i] = eeprom_read_byte((const uint8_t *) src + i);
+    }
+}
+
+void eeprom_write_block(const void *src, void *dst, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        eeprom_write_byte((uint8_t *) dst + i, ((const uint8_t *) src)[i]);
+    }
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        eeprom_update_byte((uint8_t *) dst + i, ((const uint8_t *) src)[i]);
+    }
+}
+
+bool eeprom_is_ready() {
+    return NativeSim::isEepromReady();
+}
@@ -0,0 +1,81 @@
+#ifndef NATIVESIM_NATIVESIM_H
+#define NATIVESIM_NATIVESIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Simulated MCU of the native env. Time is virtual and moves only through advanceMicros(), the blocking calls
+ * of the core (delay, writes to a full UART buffer, EEPROM writes while busy, idle sleep) and 1 us per polling call
+ * (millis, micros, Serial.available, Serial.availableForWrite), so runs are deterministic.
+ *
+ * GPIO: every pin either follows its output latch, an external driver set by setInput() or a connection to an
+ * output pin with a delay. Pin change interrupt handlers run synchronously when an enabled pin changes.
+ * Serial: bytes sent by the host arrive at the baud rate into the 64 byte RX ring, overruns are counted;
+ * bytes written by the firmware leave the TX ring at the baud rate and are collected for the host.
+ * EEPROM: optionally backed by a file, writes take 3.3 ms and are counted per cell, a power loss can be
+ * scheduled after a number of writes, further writes are lost.
+ */
+
+#define NATIVE_SIM_PORTS_COUNT 3
+#define NATIVE_SIM_EEPROM_WRITE_MICROS 3300
+
+struct NativeSimStats {
+    uint32_t rxOverruns;
+    uint32_t txBlockedMicros;
+    uint32_t sleeps;
+    uint32_t eepromWrites;
+    uint32_t eepromLostWrites;
+    uint32_t pinChangeInterrupts;
+};
+
+class NativeSim {
+public:
+    // everything back to the power on state: time 0, pins floating, empty UART, erased EEPROM without a file
+    static void reset();
+
+    static uint32_t nowMicros();
+    static void advanceMicros(uint32_t micros);
+    static void advanceMillis(uint32_t millis) {
+        advanceMicros(millis * 1000);
+    }
+
+    static void setInput(uint8_t pin, bool high);
+    static void releaseInput(uint8_t pin);
+    // input pin follows output pin after delayMicros, like a relay contact
+    static void connect(uint8_t outputPin, uint8_t inputPin, uint32_t delayMicros, bool inversed = false);
+    // input pin stops following its output pin and keeps its level, like a stuck contact
+    static void disconnect(uint8_t inputPin);
+    static bool getOutput(uint8_t pin);
+    static bool isOutput(uint8_t pin);
+    static bool readPin(uint8_t pin);
+
+    static void serialSend(const uint8_t *data, size_t size);
+    static void serialSend(uint8_t byte) {
+        serialSend(&byte, 1);
+    }
+    static bool isSerialIdle();
+    static std::vector<uint8_t> &serialReceived();
+    static uint32_t getBaudRate();
+
+    // EEPROM content is read from the file if it exists and every write goes through to it
+    static bool attachEepromFile(const char *path);
+    static void detachEepromFile();
+    static uint8_t *eepromData();
+    static uint32_t eepromCellWrites(uint16_t address);
+    static uint32_t eepromMaxCellWrites();
+    static void powerLossAfterWrites(uint32_t writes);
+    static bool isPowerLost();
+
+    static const NativeSimStats &stats();
+
+    // Hal.h back end
+    static volatile uint8_t &outputPort(uint8_t portIdx);
+    static uint8_t readPort(uint8_t portIdx);
+    static void enablePinChangeInterrupts(const uint8_t masks[NATIVE_SIM_PORTS_COUNT]);
+    static bool isEepromReady();
+    static void idleSleep();
+};
+
+#endif //NATIVESIM_NATIVESIM_H
@@ -0,0 +1,15 @@
+#ifndef NATIVESIM_AVR_EEPROM_H
+#define NATIVESIM_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_write_byte(uint8_t *address, uint8_t value);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t size);
+void eeprom_write_block(const void *src, void *dst, size_t size);
+void eeprom_update_block(const void *src, void *dst, size_t size);
+bool eeprom_is_ready();
+
+#endif //NATIVESIM_AVR_EEPROM_H
@@ -0,0 +1,10 @@
+#ifndef NATIVESIM_AVR_INTERRUPT_H
+#define NATIVESIM_AVR_INTERRUPT_H
+
+// handlers are plain functions, the simulator calls them synchronously when an enabled pin changes
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+
+inline void cli() {}
+inline void sei() {}
+
+#endif //NATIVESIM_AVR_INTERRUPT_H
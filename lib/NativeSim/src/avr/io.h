@@ -0,0 +1,31 @@
+#ifndef NATIVESIM_AVR_IO_H
+#define NATIVESIM_AVR_IO_H
+
+#include <stdint.h>
+
+/*
+ * Only the part of <avr/io.h> the firmware uses outside of Hal.h: input registers read by the pin change
+ * interrupt handlers, vectors and the EEPROM size of the simulated MCU.
+ */
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#ifdef MEM_32KB
+#define E2END 0x3FF
+#else
+#define E2END 0x1FF
+#endif
+
+uint8_t nativeReadPinRegister(uint8_t portIdx);
+
+#define PINB (nativeReadPinRegister(0))
+#define PINC (nativeReadPinRegister(1))
+#define PIND (nativeReadPinRegister(2))
+
+#define PCINT0_vect native_pcint0_vect
+#define PCINT1_vect native_pcint1_vect
+#define PCINT2_vect native_pcint2_vect
+
+#endif //NATIVESIM_AVR_IO_H
@@ -0,0 +1,30 @@
+#ifndef NATIVESIM_UTIL_CRC16_H
+#define NATIVESIM_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// C equivalents of the avr-libc inline assembler versions, as given in the avr-libc documentation
+
+inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+    crc ^= a;
+    for (uint8_t i = 0; i < 8; ++i) {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+    }
+    return crc;
+}
+
+inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+    data ^= crc & 0xff;
+    data ^= data << 4;
+    return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+}
+
+inline uint8_t _crc8_ccitt_update(uint8_t inCrc, uint8_t inData) {
+    uint8_t data = inCrc ^ inData;
+    for (uint8_t i = 0; i < 8; ++i) {
+        data = (data & 0x80) ? (uint8_t) ((data << 1) ^ 0x07) : (uint8_t) (data << 1);
+    }
+    return data;
+}
+
+#endif //NATIVESIM_UTIL_CRC16_H
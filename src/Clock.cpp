@@ -0,0 +1,26 @@
+#include "Clock.h"
+#include "utils.h"
+
+
+uint32_t Clock::nowMillis = 0;
+uint32_t Clock::nowSec = 0;
+uint16_t Clock::millisOfSec = 0;
+
+void Clock::setup() {
+    nowMillis = millis();
+    nowSec = nowMillis / MILLIS_PER_SECOND;
+    millisOfSec = nowMillis % MILLIS_PER_SECOND;
+}
+
+void Clock::update() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - nowMillis;
+    nowMillis = now;
+    //rounds take a few millis at most, so this loop usually runs once a second
+    elapsed += millisOfSec;
+    while (elapsed >= MILLIS_PER_SECOND) {
+        elapsed -= MILLIS_PER_SECOND;
+        nowSec++;
+    }
+    millisOfSec = elapsed;
+}
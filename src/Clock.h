@@ -0,0 +1,27 @@
+#ifndef RELAYCONTROLLER_CLOCK_H
+#define RELAYCONTROLLER_CLOCK_H
+
+#include "Arduino.h"
+
+/*
+ * Time of the current loop round. millis() is sampled once by update() at the round start, so all
+ * timestamps of one round are the same. Seconds are counted on from the elapsed millis, without the
+ * 32-bit division by 1000 on every use.
+ */
+class Clock {
+public:
+    static void setup();
+    static void update();
+    [[nodiscard]] static inline uint32_t getMillis() { return nowMillis; }
+    [[nodiscard]] static inline uint32_t getSec() { return nowSec; }
+    [[nodiscard]] static inline uint16_t getMillisOfSec() { return millisOfSec; }
+
+private:
+    Clock() {}
+    static uint32_t nowMillis;
+    static uint32_t nowSec;
+    static uint16_t millisOfSec;
+};
+
+
+#endif //RELAYCONTROLLER_CLOCK_H
@@ -5,6 +5,8 @@
 #ifndef RELAYCONTROLLER_COMMUNICATIONPROTOCOL_H
 #define RELAYCONTROLLER_COMMUNICATIONPROTOCOL_H
 
+#include <util/crc16.h>
+#include "TxQueue.h"
 
 enum InstructionCode {
     IC_NONE = 0x00,
@@ -23,6 +25,7 @@ enum InstructionDataCode {
     IDC_SETTINGS = 0x01,
     IDC_STATE = 0x02,
     IDC_ID = 0x03,
+    //deprecated, the inputs are latched by pin change interrupts on every pin, answered with E_INSTRUCTION_DEPRECATED
     IDC_INTERRUPT_PIN = 0x04,
     IDC_REMOTE_TIMESTAMP = 0x05,
     IDC_STATE_FIX_SETTINGS = 0x06,
@@ -49,6 +52,26 @@ enum InstructionDataCode {
     IDC_CONTROL_STATE_CHANGED = 0x17,
     IDC_GET_CYCLES_STATISTICS = 0x18,
     IDC_STATE_FIX_TRY = 0x19,
+#ifdef MEM_32KB
+    IDC_SCENE = 0x1a,
+    IDC_APPLY_SCENE = 0x1b,
+#endif
+    IDC_RELAYS_STATE_CHANGED = 0x1c,
+    IDC_TX_QUEUE_STATISTICS = 0x1d,
+#ifdef MEM_32KB
+    IDC_JOURNAL = 0x1e,
+    IDC_COMMIT_SETTINGS = 0x1f,
+#endif
+    IDC_SCHEDULER_STATISTICS = 0x20,
+#ifdef MEM_32KB
+    IDC_LATENCY_HISTOGRAM = 0x21,
+    IDC_COMMAND_CYCLES = 0x22,
+    IDC_BATCH = 0x23,
+    IDC_TELEMETRY = 0x24,
+    IDC_RELAYS_MONITORING_CHANGED = 0x25,
+    IDC_RELAYS_CONTROL_CHANGED = 0x26,
+    IDC_MERGED_EVENTS = 0x27,
+#endif
     IDC_UNKNOWN = 0xff
 };
 
@@ -65,98 +88,193 @@ enum ErrorCode {
     E_RELAY_COUNT_AND_DATA_MISMATCH = 0x09,
     E_RELAY_INDEX_OUT_OF_RANGE = 0x0a,
     E_SWITCH_COUNT_MAX_VALUE_OVERFLOW = 0x0b,
-    E_CONTROL_INTERRUPTED_PIN_NOT_ALLOWED_VALUE = 0x0c,
+    E_CONTROL_INTERRUPTED_PIN_NOT_ALLOWED_VALUE = 0x0c, //no longer sent, see IDC_INTERRUPT_PIN
+    E_SCENE_INDEX_OUT_OF_RANGE = 0x0d,
+    E_FRAME_CRC_MISMATCH = 0x0e,
+    E_FRAME_INCOMPLETE = 0x0f,
+    E_PHASE_INDEX_OUT_OF_RANGE = 0x10,
+    E_BATCH_ITEM_SKIPPED = 0x11,
+    E_BATCH_ITEM_NOT_ATOMIC = 0x12,
+    E_INSTRUCTION_DEPRECATED = 0x13,
     E_RELAY_NOT_ALLOWED_PIN_USED = 0b00100000,
     E_UNDEFINED_CODE = 128
 };
 
 static const int MAX_COMMAND_READ_TIME = 5;
+/*
+ * Framed command: FRAME_START, payload length, payload, CRC-8 (polynomial 0x07) of length and payload.
+ * Frame bytes are decoded into the command fields as they arrive, the command is executed only after the CRC
+ * matched. Bytes after the last field of the command are ignored. Batch items are kept until the CRC matched,
+ * a batch longer than BATCH_BUFF_SIZE is answered with E_COMMAND_SIZE_OVERFLOW and none of its items is executed.
+ * Payload is the same as in the legacy command without leading IC_NONE. Legacy commands are still
+ * recognized by the leading IC_NONE and completed by MAX_COMMAND_READ_TIME idle gap.
+ * In MEM_32KB build responses to framed commands carry the command id right after the data code,
+ * so a host may send several framed commands without waiting and match the responses by id:
+ *   response, success: IC_NONE, IC_RESPONSE / IC_SUCCESS, data code, id, data
+ *   command error:     IC_NONE, IC_ERROR, error code, data code, id
+ * The id of a command error is 0 when the command failed before its id was read (unknown codes, missing id).
+ * Frame errors (E_FRAME_CRC_MISMATCH, E_FRAME_INCOMPLETE, E_COMMAND_EMPTY) are sent
+ * before any command is started: IC_NONE, IC_ERROR, error code, without data code and id.
+ */
+#ifdef MEM_32KB
+/*
+ * Relay event signals of protocol version 4 (IDC_VERSION), coalesced per relay by EventSignals, replace
+ * the per relay IDC_RELAY_STATE_CHANGED, IDC_MONITORING_STATE_CHANGED and IDC_CONTROL_STATE_CHANGED of version 3:
+ *   IDC_RELAYS_STATE_CHANGED:      changed mask u16, switched on mask u16, internal switch mask u16, time u32
+ *   IDC_RELAYS_MONITORING_CHANGED: changed mask u16, monitor pin set mask u16, time u32
+ *   IDC_RELAYS_CONTROL_CHANGED:    changed mask u16, control pin set mask u16, time u32
+ */
+#define PROTOCOL_VERSION 4
+#else
+#define PROTOCOL_VERSION 1
+#endif
+#ifdef MEM_32KB
+/*
+ * Batch command (IC_COMMAND IDC_BATCH): flags, items count, then items count times main code, data code,
+ * args length, args. Items are executed in order and answered with one response: items count, one usual
+ * response (without the command id) per item and the batch result code. Items of an atomic batch may only
+ * read or set settings; when any of them fails the rest are skipped and settings are rolled back. Reads, which
+ * consume their data (IDC_SWITCH_DATA, IDC_LATENCY_HISTOGRAM, IDC_MERGED_EVENTS), fail with E_BATCH_ITEM_NOT_ATOMIC
+ * in an atomic batch.
+ * Items run only after the CRC of the whole frame matched, so a corrupt batch has no effect. An item is executed
+ * only when TX_MAX_RESPONSE_SIZE fits the TX queue, so a long batch is spread over several loop rounds;
+ * signals are held back until its response is complete.
+ */
+#define BATCH_ATOMIC_FLAG 0x01
+#endif
+static const uint8_t FRAME_START = 0xaa;
+static const int MAX_FRAME_BYTE_WAIT_TIME = 20;
+
+inline uint8_t updateFrameCrc(uint8_t crc, uint8_t value) {
+    return _crc8_ccitt_update(crc, value);
+}
 
 
-inline size_t sendSerial(bool value, Stream &serial = Serial) {
-    return serial.write(value ? 1 : 0);
+inline void sendSerial(bool value) {
+    TxQueue::putResponse(value ? 1 : 0);
 }
 
-inline size_t sendSerial(uint8_t value, Stream &serial = Serial) {
-    return serial.write(value);
+inline void sendSerial(uint8_t value) {
+    TxQueue::putResponse(value);
 }
 
-inline size_t sendSerial(InstructionCode value, Stream &serial = Serial) {
-    return sendSerial((uint8_t)value, serial);
+inline void sendSerial(InstructionCode value) {
+    sendSerial((uint8_t)value);
 }
 
-inline size_t sendSerial(InstructionDataCode value, Stream &serial = Serial) {
-    return sendSerial((uint8_t)value, serial);
+inline void sendSerial(InstructionDataCode value) {
+    sendSerial((uint8_t)value);
 }
 
-inline size_t sendSerial(ErrorCode buffer, Stream &serial = Serial) {
-    return serial.write(buffer);
+inline void sendSerial(ErrorCode value) {
+    sendSerial((uint8_t)value);
 }
 
-inline size_t sendSerial(uint16_t value, Stream &serial = Serial) {
-    uint8_t sum = 0;
-    sum += serial.write(value >> 8);
-    sum += serial.write(value & 0xFF);
-    return sum;
+inline void sendSerial(uint16_t value) {
+    sendSerial((uint8_t) (value >> 8));
+    sendSerial((uint8_t) (value & 0xFF));
 }
 
-inline size_t sendSerial(int32_t value, Stream &serial = Serial) {
-    uint8_t sum = 0;
+inline void sendSerial(int32_t value) {
     uint8_t shift = 24;
     for (uint8_t i = 0; i < 3; i++) {
-        sum += serial.write((uint8_t) ((value >> shift) & 0xFF) );
+        sendSerial((uint8_t) ((value >> shift) & 0xFF) );
         shift -= 8;
     }
-    sum += serial.write(value & 0xFF);
-    return sum;
+    sendSerial((uint8_t) (value & 0xFF));
 }
 
-inline size_t sendSerial(uint32_t value, Stream &serial = Serial) {
-    uint8_t sum = 0;
+inline void sendSerial(uint32_t value) {
     uint8_t shift = 24;
     for (uint8_t i = 0; i < 3; i++) {
-        sum += serial.write((uint8_t) ((value >> shift) & 0xFF) );
+        sendSerial((uint8_t) ((value >> shift) & 0xFF) );
         shift -= 8;
     }
-    sum += serial.write(value & 0xFF);
-    return sum;
+    sendSerial((uint8_t) (value & 0xFF));
 }
 
-inline size_t sendSerial(uint64_t value, Stream &serial = Serial) {
-    uint8_t sum = 0;
+inline void sendSerial(uint64_t value) {
     uint8_t shift = 56;
     for (uint8_t i = 0; i < 7; i++) {
-        sum += serial.write((uint8_t) ((value >> shift) & 0xFF) );
+        sendSerial((uint8_t) ((value >> shift) & 0xFF) );
         shift -= 8;
     }
-    sum += serial.write((uint8_t)(value & 0xFF));
-    return sum;
+    sendSerial((uint8_t)(value & 0xFF));
 }
 
-inline size_t sendSerial(const uint8_t *buffer, size_t size, Stream &serial = Serial) {
-    return serial.write(buffer, size);
+inline void sendSerial(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        sendSerial(buffer[i]);
+    }
 }
 
-inline size_t sendSerial(const char *buffer, Stream &serial = Serial) {
-    return serial.write(buffer);
+#ifdef MEM_32KB
+// id of the command being answered, echoed only for framed commands
+class RequestId {
+public:
+    static inline void set(uint32_t id, bool echoed) {
+        value = id;
+        echo = echoed;
+    }
+    static inline void clear() { echo = false; }
+    static inline void send() {
+        if (echo) {
+            sendSerial(value);
+        }
+    }
+private:
+    static uint32_t value;
+    static bool echo;
+};
+#endif
+
+// data code of the response header, followed by the command id when it is echoed
+inline void sendResponseCode(InstructionDataCode code) {
+    sendSerial(code);
+#ifdef MEM_32KB
+    RequestId::send();
+#endif
 }
 
 inline void sendStartResponse(InstructionDataCode code) {
     sendSerial(IC_NONE);
     sendSerial(IC_RESPONSE);
-    sendSerial(code);
+    sendResponseCode(code);
+}
+
+inline TxFrame *startSignal(InstructionDataCode code) {
+    TxFrame *frame = TxQueue::beginSignal();
+    if (frame != nullptr) {
+        frame->put((uint8_t) IC_NONE);
+        frame->put((uint8_t) IC_SIGNAL);
+        frame->put((uint8_t) code);
+    }
+    return frame;
 }
 
 inline void sendStartSignal(InstructionDataCode code) {
-    sendSerial(IC_NONE);
-    sendSerial(IC_SIGNAL);
-    sendSerial(code);
+    if (startSignal(code) != nullptr) {
+        TxQueue::commitSignal();
+    }
 }
 
 inline void sendSignal(InstructionDataCode code, uint8_t data, uint32_t timestamp) {
-    sendStartSignal(code);
-    sendSerial(data);
-    sendSerial(timestamp);
+    TxFrame *frame = startSignal(code);
+    if (frame != nullptr) {
+        frame->put(data);
+        frame->put(timestamp);
+        TxQueue::commitSignal();
+    }
+}
+
+inline void sendSignal(InstructionDataCode code, uint16_t mask, uint16_t data, uint32_t timestamp) {
+    TxFrame *frame = startSignal(code);
+    if (frame != nullptr) {
+        frame->put(mask);
+        frame->put(data);
+        frame->put(timestamp);
+        TxQueue::commitSignal();
+    }
 }
 
 #endif //RELAYCONTROLLER_COMMUNICATIONPROTOCOL_H
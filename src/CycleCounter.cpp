@@ -0,0 +1,29 @@
+#include "CycleCounter.h"
+
+#ifdef CYCLE_PROFILING
+
+#include "Hal.h"
+
+volatile uint16_t cycleTimerOverflows = 0;
+
+ISR(TIMER1_OVF_vect) {
+    cycleTimerOverflows++;
+}
+
+void CycleCounter::setup() {
+    halStartCycleTimer();
+}
+
+uint32_t CycleCounter::read() {
+    InterruptLock lock;
+    bool pendingOverflow;
+    uint16_t low = halReadCycleTimer(pendingOverflow);
+    uint16_t high = cycleTimerOverflows;
+    //overflow happened after interrupts were disabled, but is not counted yet
+    if (pendingOverflow && low < 0x8000) {
+        high++;
+    }
+    return ((uint32_t) high << 16) | low;
+}
+
+#endif
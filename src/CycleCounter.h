@@ -0,0 +1,29 @@
+#ifndef RELAYCONTROLLER_CYCLECOUNTER_H
+#define RELAYCONTROLLER_CYCLECOUNTER_H
+
+#include "Arduino.h"
+
+#ifdef CYCLE_PROFILING
+#ifndef MEM_32KB
+#error "CYCLE_PROFILING needs the MEM_32KB build"
+#endif
+#define CYCLES_PER_MICROSECOND (F_CPU / 1000000UL)
+
+/*
+ * Profiling builds only (CYCLE_PROFILING, see the ATmega328P_profile env). The counter takes Timer1 over:
+ * it runs without prescaler and is extended to 32 bits by its overflow interrupt, taken every 65536 cycles
+ * (about 4 ms at 16 MHz), so hot paths are measured in exact cycles, not in 4 us micros() steps.
+ * Timer1 PWM (analogWrite on pins 9 and 10) and anything else using Timer1 do not work in these builds.
+ */
+class CycleCounter {
+public:
+    static void setup();
+    static uint32_t read();
+
+private:
+    CycleCounter() {}
+};
+#endif
+
+
+#endif //RELAYCONTROLLER_CYCLECOUNTER_H
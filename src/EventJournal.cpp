@@ -0,0 +1,103 @@
+#include "EventJournal.h"
+
+#ifdef MEM_32KB
+
+#include "Hal.h"
+#include <util/crc16.h>
+
+static_assert(JOURNAL_LOCATION + JOURNAL_RECORDS_COUNT * JOURNAL_RECORD_SIZE <= SETTINGS_SLOTS_LOCATION,
+        "event journal overlaps settings slots");
+
+JournalRecord EventJournal::queue[JOURNAL_QUEUE_SIZE];
+uint8_t EventJournal::queueHead = 0;
+uint8_t EventJournal::queueCount = 0;
+uint8_t EventJournal::recordBytes[JOURNAL_RECORD_SIZE];
+uint8_t EventJournal::writePos = 0;
+uint16_t EventJournal::nextSeq = 0;
+uint16_t EventJournal::droppedCount = 0;
+
+void EventJournal::encode(const JournalRecord &record, uint8_t *bytes) {
+    bytes[0] = record.seq >> 8;
+    bytes[1] = record.seq;
+    bytes[2] = record.state;
+    bytes[3] = record.time >> 24;
+    bytes[4] = record.time >> 16;
+    bytes[5] = record.time >> 8;
+    bytes[6] = record.time;
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < JOURNAL_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    }
+    bytes[JOURNAL_RECORD_SIZE - 1] = crc;
+}
+
+bool EventJournal::readSlot(uint8_t slot, JournalRecord &record) {
+    uint8_t bytes[JOURNAL_RECORD_SIZE];
+    eeprom_read_block(bytes, slotAddress(slot), JOURNAL_RECORD_SIZE);
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < JOURNAL_RECORD_SIZE - 1; i++) {
+        crc = _crc8_ccitt_update(crc, bytes[i]);
+    }
+    record.seq = ((uint16_t) bytes[0] << 8) | bytes[1];
+    record.state = bytes[2];
+    record.time = ((uint32_t) bytes[3] << 24) | ((uint32_t) bytes[4] << 16) | ((uint16_t) bytes[5] << 8) | bytes[6];
+    return crc == bytes[JOURNAL_RECORD_SIZE - 1] && record.seq % JOURNAL_RECORDS_COUNT == slot;
+}
+
+void EventJournal::setup() {
+    JournalRecord record;
+    JournalRecord next;
+    bool nextValid = readSlot(0, next);
+    nextSeq = 0;
+    //newest record is the valid one, which is not followed by its successor
+    for (uint8_t slot = JOURNAL_RECORDS_COUNT; slot > 0; slot--) {
+        bool valid = readSlot(slot - 1, record);
+        if (valid && !(nextValid && next.seq == (uint16_t) (record.seq + 1))) {
+            nextSeq = record.seq + 1;
+            break;
+        }
+        next = record;
+        nextValid = valid;
+    }
+    queueCount = 0;
+    writePos = 0;
+}
+
+void EventJournal::add(uint8_t state, uint32_t time) {
+    if (queueCount == JOURNAL_QUEUE_SIZE) {
+        droppedCount++;
+        return;
+    }
+    JournalRecord &record = queue[(queueHead + queueCount) % JOURNAL_QUEUE_SIZE];
+    record.state = state;
+    record.time = time;
+    queueCount++;
+}
+
+bool EventJournal::idle() {
+    if (queueCount == 0 || !halIsEepromReady()) return false;
+    if (writePos == 0) {
+        JournalRecord &record = queue[queueHead];
+        record.seq = nextSeq;
+        encode(record, recordBytes);
+    }
+    uint8_t *address = slotAddress(nextSeq) + writePos;
+    //unchanged cells are not rewritten
+    if (eeprom_read_byte(address) != recordBytes[writePos]) {
+        eeprom_write_byte(address, recordBytes[writePos]);
+    }
+    writePos++;
+    if (writePos == JOURNAL_RECORD_SIZE) {
+        writePos = 0;
+        nextSeq++;
+        queueHead = (queueHead + 1) % JOURNAL_QUEUE_SIZE;
+        queueCount--;
+    }
+    return true;
+}
+
+bool EventJournal::readRecord(uint16_t seq, JournalRecord &record) {
+    return readSlot(seq % JOURNAL_RECORDS_COUNT, record) && record.seq == seq;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef RELAYCONTROLLER_EVENTJOURNAL_H
+#define RELAYCONTROLLER_EVENTJOURNAL_H
+
+#include "Arduino.h"
+#include "Settings.h"
+
+#ifdef MEM_32KB
+
+#define JOURNAL_LOCATION (SCENES_LOCATION + MAX_SCENES_COUNT * sizeof (RelayScene))
+#define JOURNAL_RECORD_SIZE 8
+//power of two, so the slot order survives the sequence wrap
+#define JOURNAL_RECORDS_COUNT 32
+#define JOURNAL_QUEUE_SIZE 4
+#define JOURNAL_MAX_READ_COUNT 16
+
+struct JournalRecord {
+    uint16_t seq;
+    uint8_t state;
+    uint32_t time;
+};
+
+/*
+ * Switch events kept in EEPROM as a circular journal of JOURNAL_RECORDS_COUNT slots. Record with sequence
+ * number seq is stored in slot seq % JOURNAL_RECORDS_COUNT as: seq u16, state u8, remote time u32 (big endian)
+ * and CRC-8 of these bytes, written last. A record torn by a reset fails the CRC check and is skipped,
+ * the newest valid record is found by the slot scan on boot. Slots are rewritten strictly in turn,
+ * so every cell gets the same number of writes.
+ * Events are queued in RAM and written from idle() one byte at a time, only when the EEPROM is ready,
+ * so the control loop never waits for the ~3.3 ms byte write.
+ */
+class EventJournal {
+public:
+    static void setup();
+    static bool idle();
+    static void add(uint8_t state, uint32_t time);
+    static bool readRecord(uint16_t seq, JournalRecord &record);
+    [[nodiscard]] static inline uint16_t getNextSeq() { return nextSeq; }
+    [[nodiscard]] static inline uint16_t getDroppedCount() { return droppedCount; }
+
+private:
+    static JournalRecord queue[JOURNAL_QUEUE_SIZE];
+    static uint8_t queueHead;
+    static uint8_t queueCount;
+    static uint8_t recordBytes[JOURNAL_RECORD_SIZE];
+    static uint8_t writePos;
+    static uint16_t nextSeq;
+    static uint16_t droppedCount;
+
+    static void encode(const JournalRecord &record, uint8_t *bytes);
+    static bool readSlot(uint8_t slot, JournalRecord &record);
+    static inline uint8_t *slotAddress(uint16_t seq) {
+        return (uint8_t *) (JOURNAL_LOCATION + (seq % JOURNAL_RECORDS_COUNT) * JOURNAL_RECORD_SIZE);
+    }
+};
+
+#endif
+
+#endif //RELAYCONTROLLER_EVENTJOURNAL_H
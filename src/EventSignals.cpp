@@ -0,0 +1,103 @@
+#include "EventSignals.h"
+
+#ifdef MEM_32KB
+
+#include "RelayController.h"
+#include "CommunicationProtocol.h"
+#include "Clock.h"
+#include "utils.h"
+
+static const InstructionDataCode EVENT_SIGNAL_CODES[EK_COUNT] = {
+        IDC_RELAYS_STATE_CHANGED,
+        IDC_RELAYS_MONITORING_CHANGED,
+        IDC_RELAYS_CONTROL_CHANGED
+};
+
+uint16_t EventSignals::pending[EK_COUNT];
+uint16_t EventSignals::values[EK_COUNT];
+uint16_t EventSignals::internalSwitches = 0;
+uint16_t EventSignals::openWindows[EK_COUNT];
+uint8_t EventSignals::windowStarts[EK_COUNT][MAX_RELAYS_COUNT];
+uint8_t EventSignals::mergedCounts[MAX_RELAYS_COUNT];
+
+void EventSignals::add(EventKind kind, uint16_t mask, uint16_t newValues, uint16_t internal) {
+    uint16_t merged = pending[kind] & mask;
+    for (uint8_t i = 0; merged != 0; i++, merged >>= 1) {
+        if ((merged & 1) && mergedCounts[i] < MAX_MERGED_COUNT) {
+            mergedCounts[i]++;
+        }
+    }
+    pending[kind] |= mask;
+    values[kind] = (values[kind] & ~mask) | (newValues & mask);
+    if (kind == EK_RELAY_STATE) {
+        internalSwitches = (internalSwitches & ~mask) | (internal & mask);
+    }
+    //relays without an open window are sent right away
+    uint16_t due = pending[kind] & ~openWindows[kind];
+    if (due != 0) {
+        send(kind, due);
+    }
+}
+
+bool EventSignals::idle() {
+    bool worked = false;
+    auto now = (uint8_t) Clock::getMillis();
+    for (uint8_t kind = 0; kind < EK_COUNT; kind++) {
+        uint16_t open = openWindows[kind];
+        if (open == 0) {
+            continue;
+        }
+        uint16_t ended = 0;
+        for (uint8_t i = 0; open != 0; i++, open >>= 1) {
+            if ((open & 1) && (uint8_t) (now - windowStarts[kind][i]) >= SIGNAL_COALESCE_MILLIS) {
+                ended |= 1 << i;
+            }
+        }
+        if (ended == 0) {
+            continue;
+        }
+        //nothing came during the window, the next change is sent right away
+        openWindows[kind] &= ~(ended & ~pending[kind]);
+        uint16_t due = pending[kind] & ended;
+        if (due != 0) {
+            worked |= send((EventKind) kind, due);
+        }
+    }
+    return worked;
+}
+
+bool EventSignals::send(EventKind kind, uint16_t relays) {
+    TxFrame *frame = startSignal(EVENT_SIGNAL_CODES[kind]);
+    //not sent changes stay pending until the window ends
+    openWindow(kind, relays);
+    if (frame == nullptr) {
+        return false;
+    }
+    frame->put(relays);
+    frame->put((uint16_t) (values[kind] & relays));
+    if (kind == EK_RELAY_STATE) {
+        frame->put((uint16_t) (internalSwitches & relays));
+    }
+    frame->put(RelayController::getRemoteTimeSec());
+    TxQueue::commitSignal();
+    pending[kind] &= ~relays;
+    return true;
+}
+
+void EventSignals::openWindow(EventKind kind, uint16_t relays) {
+    openWindows[kind] |= relays;
+    auto now = (uint8_t) Clock::getMillis();
+    for (uint8_t i = 0; relays != 0; i++, relays >>= 1) {
+        if (relays & 1) {
+            windowStarts[kind][i] = now;
+        }
+    }
+}
+
+void EventSignals::clearMergedCounts() {
+    for (uint8_t &count : mergedCounts) {
+        count = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef RELAYCONTROLLER_EVENTSIGNALS_H
+#define RELAYCONTROLLER_EVENTSIGNALS_H
+
+#include "Arduino.h"
+#include "Settings.h"
+
+#ifdef MEM_32KB
+
+#define SIGNAL_COALESCE_MILLIS 50
+#define MAX_MERGED_COUNT 0xff
+
+enum EventKind : uint8_t {
+    EK_RELAY_STATE,
+    EK_MONITORING,
+    EK_CONTROL,
+    EK_COUNT
+};
+
+/*
+ * Relay events coalesced per relay into signals with changed relays mask and their new values mask (u16 each),
+ * for relay state also the internal switches mask (u16), and remote time sec (u32).
+ * The first change of a relay is sent right away and opens SIGNAL_COALESCE_MILLIS window of that relay and kind,
+ * its changes during the window are merged and sent when the window ends, so a relay takes at most one frame
+ * of a kind per window and a chattering relay delays only itself. Relays due at the same time share a frame.
+ * A relay changing again before its previous change was sent has the older change merged and counted in its
+ * merged count. A frame not fitting the TX queue stays pending and is retried when the window ends.
+ * Window starts are kept as the low byte of millis(), idle() is called far more often than every 255 ms.
+ */
+class EventSignals {
+public:
+    static void add(EventKind kind, uint16_t mask, uint16_t values, uint16_t internal = 0);
+    static bool idle();
+    [[nodiscard]] static inline uint8_t getMergedCount(uint8_t relayIdx) { return mergedCounts[relayIdx]; }
+    static void clearMergedCounts();
+
+private:
+    EventSignals() {}
+    static uint16_t pending[EK_COUNT];
+    static uint16_t values[EK_COUNT];
+    static uint16_t internalSwitches;
+    static uint16_t openWindows[EK_COUNT];
+    static uint8_t windowStarts[EK_COUNT][MAX_RELAYS_COUNT];
+    static uint8_t mergedCounts[MAX_RELAYS_COUNT];
+
+    static bool send(EventKind kind, uint16_t relays);
+    static void openWindow(EventKind kind, uint16_t relays);
+};
+
+#endif
+
+#endif //RELAYCONTROLLER_EVENTSIGNALS_H
@@ -0,0 +1,31 @@
+#include "FirmwareSetup.h"
+#include "RelayController.h"
+#include "Scheduler.h"
+#include "Clock.h"
+#include "CycleCounter.h"
+#include "TxQueue.h"
+
+// the tasks are plain function pointers
+static Settings *firmwareSettings = nullptr;
+static Server *firmwareServer = nullptr;
+
+void setupFirmware(Settings &settings, Server &server) {
+    firmwareSettings = &settings;
+    firmwareServer = &server;
+    Serial.begin(SERIAL_BAUD_RATE);
+    delay(100);
+    Clock::setup();
+#ifdef CYCLE_PROFILING
+    CycleCounter::setup();
+#endif
+    settings.load();
+    RelayController::setup(settings);
+    server.setup();
+    Scheduler::setTask(ST_INPUTS, RelayController::processInputs);
+    Scheduler::setTask(ST_SERIAL_RX, []() { return firmwareServer->receive(); });
+    Scheduler::setTask(ST_SERIAL_TX, TxQueue::drain);
+    Scheduler::setTask(ST_MAINTENANCE, []() {
+        bool worked = RelayController::maintain();
+        return firmwareSettings->idle() || worked;
+    });
+}
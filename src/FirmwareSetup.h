@@ -0,0 +1,16 @@
+#ifndef RELAYCONTROLLER_FIRMWARESETUP_H
+#define RELAYCONTROLLER_FIRMWARESETUP_H
+
+#include "Settings.h"
+#include "Server.h"
+
+#define SERIAL_BAUD_RATE 18200
+
+/*
+ * Power on wiring of the modules and the scheduler tasks, called by setup() of main.cpp and by the native
+ * test harness, so both run the same firmware.
+ */
+void setupFirmware(Settings &settings, Server &server);
+
+
+#endif //RELAYCONTROLLER_FIRMWARESETUP_H
@@ -0,0 +1,128 @@
+#ifndef RELAYCONTROLLER_HAL_H
+#define RELAYCONTROLLER_HAL_H
+
+#include "Arduino.h"
+
+/*
+ * Direct register access of the firmware, apart from interrupt vectors: GPIO ports, pin change interrupts,
+ * interrupts masking, cycle timer, simulator markers, EEPROM ready state and sleep. Everything else goes through
+ * the Arduino core API, so another target or a host build only has to provide this header and the core.
+ */
+
+#define PORTS_COUNT 3
+#define PORT_B_IDX 0
+#define PORT_C_IDX 1
+#define PORT_D_IDX 2
+
+#ifdef NATIVE
+// host build of the native env, the same functions are backed by the simulator of lib/NativeSim
+#include "NativeHal.h"
+#else
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+
+// interrupts are disabled while the lock exists, the previous state is restored by the destructor
+class InterruptLock {
+public:
+    InterruptLock() : oldSREG(SREG) {
+        cli();
+    }
+    ~InterruptLock() {
+        SREG = oldSREG;
+    }
+private:
+    uint8_t oldSREG;
+};
+
+template<uint8_t PORT_IDX>
+inline volatile uint8_t &halOutputPort() {
+    return PORT_IDX == PORT_B_IDX ? PORTB : (PORT_IDX == PORT_C_IDX ? PORTC : PORTD);
+}
+
+// all input ports are read at the same moment
+inline void halReadPorts(uint8_t ports[PORTS_COUNT]) {
+    InterruptLock lock;
+    ports[PORT_B_IDX] = PINB;
+    ports[PORT_C_IDX] = PINC;
+    ports[PORT_D_IDX] = PIND;
+}
+
+// every port is written once with interrupts disabled, so all pins of the group switch together
+inline void halWritePorts(const uint8_t lowMasks[PORTS_COUNT], const uint8_t highMasks[PORTS_COUNT]) {
+    InterruptLock lock;
+    PORTB = (PORTB & ~lowMasks[PORT_B_IDX]) | highMasks[PORT_B_IDX];
+    PORTC = (PORTC & ~lowMasks[PORT_C_IDX]) | highMasks[PORT_C_IDX];
+    PORTD = (PORTD & ~lowMasks[PORT_D_IDX]) | highMasks[PORT_D_IDX];
+}
+
+#ifdef MEM_32KB
+// pin change interrupts of the ports are enabled only for the masked pins, pending flags are dropped
+inline void halEnablePinChangeInterrupts(const uint8_t masks[PORTS_COUNT]) {
+    InterruptLock lock;
+    PCMSK0 = masks[PORT_B_IDX];
+    PCMSK1 = masks[PORT_C_IDX];
+    PCMSK2 = masks[PORT_D_IDX];
+    uint8_t pcicr = 0;
+    if (masks[PORT_B_IDX]) {
+        pcicr |= _BV(PCIE0);
+    }
+    if (masks[PORT_C_IDX]) {
+        pcicr |= _BV(PCIE1);
+    }
+    if (masks[PORT_D_IDX]) {
+        pcicr |= _BV(PCIE2);
+    }
+    PCIFR = _BV(PCIF0) | _BV(PCIF1) | _BV(PCIF2);
+    PCICR = pcicr;
+}
+
+#ifdef CYCLE_PROFILING
+// Timer1 in normal mode counts CPU cycles, overflow interrupt is enabled
+inline void halStartCycleTimer() {
+    InterruptLock lock;
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+}
+
+// to be called with interrupts disabled, pendingOverflow reports an overflow not handled yet
+inline uint16_t halReadCycleTimer(bool &pendingOverflow) {
+    uint16_t count = TCNT1;
+    pendingOverflow = TIFR1 & _BV(TOV1);
+    return count;
+}
+#endif
+#endif
+
+#ifdef SIM_PROFILING
+/*
+ * Simulator builds only (SIM_PROFILING, see the *_sim envs). The simavr harness of test/simavr takes the CPU cycle
+ * of every write of this register as a loop phase start or end. The ATmega8 has no general purpose I/O register,
+ * its TWI address register is used instead, it has no effect while TWI is off.
+ */
+#ifdef GPIOR0
+#define SIM_MARKER_REGISTER GPIOR0
+#else
+#define SIM_MARKER_REGISTER TWAR
+#endif
+
+inline void halSimMarker(uint8_t value) {
+    SIM_MARKER_REGISTER = value;
+}
+#endif
+
+inline bool halIsEepromReady() {
+    return eeprom_is_ready();
+}
+
+// CPU stops until the next interrupt, timers and UART keep running
+inline void halIdleSleep() {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_mode();
+}
+#endif
+
+
+#endif //RELAYCONTROLLER_HAL_H
@@ -0,0 +1,33 @@
+#include "LatencyHistograms.h"
+
+#ifdef MEM_32KB
+
+uint16_t LatencyHistograms::counts[LP_COUNT][LATENCY_BUCKETS_COUNT];
+uint32_t LatencyHistograms::maxTicks[LP_COUNT];
+
+uint32_t LatencyHistograms::record(LoopPhase phase, uint32_t startTicks) {
+    uint32_t ticks = readLatencyTicks() - startTicks;
+    if (ticks > maxTicks[phase]) {
+        maxTicks[phase] = ticks;
+    }
+    uint32_t duration = ticks / LATENCY_TICKS_PER_MICROSECOND;
+    uint8_t bucket = 0;
+    while (duration != 0 && bucket < LATENCY_BUCKETS_COUNT - 1) {
+        duration >>= 1;
+        bucket++;
+    }
+    uint16_t &count = counts[phase][bucket];
+    if (count != 0xffff) {
+        count++;
+    }
+    return ticks;
+}
+
+void LatencyHistograms::clear(LoopPhase phase) {
+    for (uint16_t &count : counts[phase]) {
+        count = 0;
+    }
+    maxTicks[phase] = 0;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef RELAYCONTROLLER_LATENCYHISTOGRAMS_H
+#define RELAYCONTROLLER_LATENCYHISTOGRAMS_H
+
+#include "Arduino.h"
+#include "CycleCounter.h"
+
+#ifdef CYCLE_PROFILING
+#define LATENCY_TICKS_PER_MICROSECOND CYCLES_PER_MICROSECOND
+inline uint32_t readLatencyTicks() { return CycleCounter::read(); }
+#else
+// micros() has 4 us resolution at 16 MHz, Timer1 is left to the application
+#define LATENCY_TICKS_PER_MICROSECOND 1
+inline uint32_t readLatencyTicks() { return micros(); }
+#endif
+
+enum LoopPhase : uint8_t {
+    LP_INPUT_SCAN = 0,
+    LP_CONTROL = 1,
+    LP_STATE_FIX = 2,
+    LP_COMMAND_PARSE = 3,
+    LP_COMMAND_EXECUTE = 4,
+    LP_TX = 5,
+    LP_LOOP = 6,
+    LP_COUNT = 7
+};
+
+#ifdef SIM_PROFILING
+#include "Hal.h"
+// phase start is marked by SIM_MARKER_START | phase, its end by the phase, test/simavr counts the cycles between
+#define SIM_MARKER_START 0x80
+#define PHASE_MARK_START(phase) halSimMarker(SIM_MARKER_START | (phase))
+#define PHASE_MARK_END(phase) halSimMarker(phase)
+#else
+#define PHASE_MARK_START(phase) ((void) 0)
+#define PHASE_MARK_END(phase) ((void) 0)
+#endif
+
+#define LATENCY_BUCKETS_COUNT 16
+
+#ifdef MEM_32KB
+/*
+ * Durations of loop phases counted in log2 buckets of micros: bucket 0 - below 1 us, bucket b - from 2^(b-1)
+ * to 2^b - 1 us, the last bucket takes everything longer. Counters saturate, so percentiles stay usable until
+ * the histogram is fetched and reset. The worst case is kept in ticks: micros, or CPU cycles in
+ * CYCLE_PROFILING builds. LP_LOOP is the whole scheduler round without the sleep.
+ */
+class LatencyHistograms {
+public:
+    static uint32_t record(LoopPhase phase, uint32_t startTicks);
+    [[nodiscard]] static inline uint16_t getCount(LoopPhase phase, uint8_t bucket) { return counts[phase][bucket]; }
+    [[nodiscard]] static inline uint32_t getMaxTicks(LoopPhase phase) { return maxTicks[phase]; }
+    static void clear(LoopPhase phase);
+
+private:
+    LatencyHistograms() {}
+    static uint16_t counts[LP_COUNT][LATENCY_BUCKETS_COUNT];
+    static uint32_t maxTicks[LP_COUNT];
+};
+
+#define PHASE_START(phase, var) uint32_t var = (PHASE_MARK_START(phase), readLatencyTicks())
+#define PHASE_END(phase, var) (PHASE_MARK_END(phase), LatencyHistograms::record(phase, var))
+#else
+#define PHASE_START(phase, var) PHASE_MARK_START(phase)
+#define PHASE_END(phase, var) PHASE_MARK_END(phase)
+#endif
+
+
+#endif //RELAYCONTROLLER_LATENCYHISTOGRAMS_H
@@ -4,6 +4,13 @@
 
 #include "RelayController.h"
 #include "CommunicationProtocol.h"
+#include "EventJournal.h"
+#include "Clock.h"
+#include "LatencyHistograms.h"
+#include "Hal.h"
+#include "Telemetry.h"
+#include "EventSignals.h"
+#include "SwitchLimiter.h"
 
 
 #define CONTACT_READY_WAIT_DATA_STARTED_BIT 15
@@ -12,6 +19,10 @@
 #define CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK BF_MASK(0, CONTACT_READY_WAIT_DATA_LAST_CHANGE_LENGTH)
 #define REQUEST_TIME_STAMP_INTERVAL 10
 
+#ifdef STATIC_RELAYS
+#include "StaticRelays.h"
+#endif
+
 SettingsPtr settings_;
 /*
 inline void sendSerialDbg(uint8_t v) { sendSerial(v); }
@@ -27,16 +38,19 @@ private:
     uint32_t startWaitSec;
 #endif
 
+    [[nodiscard]] inline uint16_t getWaitedMillis() const {
+        return ((uint16_t) Clock::getMillis() - data) & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK;
+    }
     [[nodiscard]] inline bool isWaitFinished() const {
-        return (millis() & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK) - (data & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK)
+        return getWaitedMillis()
             >= (settings_.getStateFixSettings().getContactReadyWaitDelayMillis() & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK);
     }
-    inline void startWait(bool pinSet) {
+    inline void startWait(bool pinSet, uint16_t changeMillis) {
 
 #ifdef MEM_32KB
         startWaitSec = RelayController::getRemoteTimeSec();
 #endif
-        data = (1 << CONTACT_READY_WAIT_DATA_STARTED_BIT) | (millis() & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK);
+        data = (1 << CONTACT_READY_WAIT_DATA_STARTED_BIT) | (changeMillis & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK);
         setBit(data, CONTACT_READY_WAIT_DATA_LAST_STATE_BIT, pinSet);
     }
     inline void stopWait() {
@@ -45,10 +59,10 @@ private:
         startWaitSec = 0;
 #endif
     }
-    inline void update(bool value) {
+    inline void update(bool value, uint16_t changeMillis) {
         bool lastStateOn = CHECK_BIT(data, CONTACT_READY_WAIT_DATA_LAST_STATE_BIT);
         if (lastStateOn != value) {
-            data = (1 << CONTACT_READY_WAIT_DATA_STARTED_BIT) | (millis() & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK);
+            data = (1 << CONTACT_READY_WAIT_DATA_STARTED_BIT) | (changeMillis & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK);
             setBit(data, CONTACT_READY_WAIT_DATA_LAST_STATE_BIT, value);
         }
     }
@@ -61,15 +75,19 @@ public:
     [[nodiscard]] inline bool isWaitStarted() const {
         return CHECK_BIT(data, CONTACT_READY_WAIT_DATA_STARTED_BIT);
     }
-    inline bool checkReady(bool ctrlPinSet) {
+    [[nodiscard]] inline uint16_t getReadyMillis() const {
+        return (uint16_t) Clock::getMillis() - getWaitedMillis()
+            + (settings_.getStateFixSettings().getContactReadyWaitDelayMillis() & CONTACT_READY_WAIT_DATA_LAST_CHANGE_MASK);
+    }
+    inline bool checkReady(bool ctrlPinSet, uint16_t changeMillis) {
         if (!isWaitStarted()) {
-            startWait(ctrlPinSet);
+            startWait(ctrlPinSet, changeMillis);
             return false;
         } else if (isWaitFinished()) {
             stopWait();
             return true;
         } else {
-            update(ctrlPinSet);
+            update(ctrlPinSet, changeMillis);
             return false;
         }
     }
@@ -82,109 +100,88 @@ public:
 };
 
 
-#ifdef MEM_32KB
-#define SWITCH_LIMIT_DATA_LENGTH 4
-#define SWITCH_LIMIT_DATA_MASK BF_MASK(0, SWITCH_LIMIT_DATA_LENGTH)
-#define SWITCH_LIMIT_MONITOR_DATA_CAPACITY (1 << SWITCH_LIMIT_DATA_LENGTH)
-#define SWITCH_LIMIT_DATA_COUNT_PER_BYTE (8 / SWITCH_LIMIT_DATA_LENGTH)
-#define SWITCH_LIMITER_DATA_BYTES_COUNT (MAX_SWITCH_LIMIT_COUNT / SWITCH_LIMIT_DATA_COUNT_PER_BYTE)
-#define MONITORING_INTERVAL_PER_CONTROL_INTERVAL_RATIO 2
-#define SWITCH_LIMIT_CONTROL_DATA_CAPACITY (SWITCH_LIMIT_MONITOR_DATA_CAPACITY / MONITORING_INTERVAL_PER_CONTROL_INTERVAL_RATIO)
-
-struct SwitchLimiter {
-    uint8_t data[SWITCH_LIMITER_DATA_BYTES_COUNT];
-    uint8_t count = 0;
-
-    void update() {
-        uint16_t switchLimitIntervalSec = settings_.getSwitchCountingSettingsRef().getSwitchLimitIntervalSec();
-        auto monitoringInterval = (uint32_t) MILLIS_PER_SECOND * switchLimitIntervalSec * MONITORING_INTERVAL_PER_CONTROL_INTERVAL_RATIO;
-        auto stamp = (uint8_t) ( ( millis() % monitoringInterval ) * SWITCH_LIMIT_MONITOR_DATA_CAPACITY / monitoringInterval);
-        auto controlInterval = (uint32_t) MILLIS_PER_SECOND * switchLimitIntervalSec;
-        auto controlStamp = (uint8_t) ( ( millis() % controlInterval ) * SWITCH_LIMIT_CONTROL_DATA_CAPACITY / controlInterval);
-
-        uint8_t outdatedCount = 0;
-        uint8_t blocksCount = (count + SWITCH_LIMIT_DATA_COUNT_PER_BYTE - 1) / SWITCH_LIMIT_DATA_COUNT_PER_BYTE;
-        uint8_t maxOutdatedValue;
-        if (stamp - controlStamp == 0) {
-            maxOutdatedValue = controlStamp;
-        } else {
-            maxOutdatedValue = controlStamp + SWITCH_LIMIT_CONTROL_DATA_CAPACITY;
-        }
-        for (uint8_t i = 0; i < blocksCount; i++) {
-            if ((data[i / SWITCH_LIMIT_DATA_LENGTH] & SWITCH_LIMIT_DATA_MASK) <= maxOutdatedValue) {
-                outdatedCount++;
-                if (i + 1 < count && (data[i / SWITCH_LIMIT_DATA_LENGTH] >> SWITCH_LIMIT_DATA_LENGTH) <= maxOutdatedValue) {
-                    outdatedCount++;
-                } else {
-                    break;
-                }
-            } else {
-                break;
-            }
-        }
-        count -= outdatedCount;
-        if (outdatedCount % SWITCH_LIMIT_DATA_COUNT_PER_BYTE == 0) {
-            for (uint8_t i = 0; i < blocksCount; i++) {
-                uint8_t earliestActualBlock = i + outdatedCount / SWITCH_LIMIT_DATA_COUNT_PER_BYTE;
-                if (earliestActualBlock < blocksCount) {
-                    data[i] = data[earliestActualBlock];
-                }
-            }
-        } else {
-            for (uint8_t i = 0; i < blocksCount; i++) {
-                uint8_t earliestActualBlock = i + outdatedCount / SWITCH_LIMIT_DATA_COUNT_PER_BYTE;
-                if (earliestActualBlock < blocksCount) {
-                    data[i] = data[earliestActualBlock] >> SWITCH_LIMIT_DATA_LENGTH;
-                    if (earliestActualBlock + 1 < blocksCount) {
-                        data[i] |= data[earliestActualBlock + 1] << SWITCH_LIMIT_DATA_LENGTH;
-                    }
-                }
-            }
-        }
-    }
+// per relay deadlines with the earliest one cached, so a loop with nothing due costs a single compare
+template<typename T>
+struct RelayDeadlines {
+    uint16_t armed = 0;
+    T earliest = 0;
+    T deadlines[MAX_RELAYS_COUNT];
 
-    bool tryAdd() {
-        uint8_t switchMaxCount = settings_.getSwitchCountingSettingsRef().getMaxSwitchCount();
-        if (switchMaxCount == 0) {
-            return true;
-        }
-        if (switchMaxCount > MAX_SWITCH_LIMIT_COUNT) {
-            switchMaxCount = MAX_SWITCH_LIMIT_COUNT;
+    static inline bool isBefore(T time, T deadline) {
+        return (T) (time - deadline) > (T) (~(T) 0 >> 1);
+    }
+    inline void arm(uint8_t relayIdx, T deadline) {
+        if (armed == 0 || isBefore(deadline, earliest)) {
+            earliest = deadline;
         }
-        if (count >= switchMaxCount) {
-            return false;
+        deadlines[relayIdx] = deadline;
+        setBit(armed, relayIdx, true);
+    }
+    // cached earliest deadline may get too early, it is corrected on the next takeExpired()
+    inline void cancel(uint16_t relaysMask) {
+        armed &= ~relaysMask;
+    }
+    uint16_t takeExpired(T now) {
+        if (armed == 0 || isBefore(now, earliest)) {
+            return 0;
         }
-        uint16_t switchLimitIntervalSec = settings_.getSwitchCountingSettingsRef().getSwitchLimitIntervalSec();
-        auto monitoringInterval = (uint32_t) MILLIS_PER_SECOND * switchLimitIntervalSec * MONITORING_INTERVAL_PER_CONTROL_INTERVAL_RATIO;
-        auto stamp = (uint8_t)( ( (millis() % monitoringInterval) ) * SWITCH_LIMIT_MONITOR_DATA_CAPACITY / monitoringInterval);
-        if (count < MAX_SWITCH_LIMIT_COUNT - 1) {
-            if (count % SWITCH_LIMIT_DATA_COUNT_PER_BYTE == 1) {
-                data[count / SWITCH_LIMIT_DATA_LENGTH] |= stamp << SWITCH_LIMIT_DATA_LENGTH;
-            } else {
-                data[count / SWITCH_LIMIT_DATA_LENGTH] = stamp;
+        uint16_t expired = 0;
+        bool pending = false;
+        uint16_t rest = armed;
+        for (uint8_t i = 0; rest != 0; i++, rest >>= 1) {
+            if (!(rest & 1)) {
+                continue;
+            }
+            T deadline = deadlines[i];
+            if (!isBefore(now, deadline)) {
+                expired |= 1 << i;
+            } else if (!pending || isBefore(deadline, earliest)) {
+                earliest = deadline;
+                pending = true;
             }
-            count++;
-            return true;
-        } else {
-            return false;
         }
-    }
-
-    void clear() {
-        count = 0;
+        armed &= ~expired;
+        return expired;
     }
 };
 
+#ifdef MEM_32KB
 SwitchLimiter switchLimiters[MAX_RELAYS_COUNT];
-struct StateSwitchData {
-    uint8_t state;
-    uint32_t time;
-};
-StateSwitchData stateSwitchDatas[SWITCHES_DATA_BUFFER_SIZE];
-uint8_t stateSwitchCount = 0;
-bool lastInterruptPinHigh = false;
+volatile uint8_t pinChangeLastPorts[PORTS_COUNT];
+volatile uint8_t pinChangePending[PORTS_COUNT];
+volatile uint16_t pinChangeTimes[PORTS_COUNT];
 #endif
+struct PinLocation {
+    uint8_t portIdx;
+    uint8_t mask;
+};
+
 ContactWaitData lastChangeWaitDatas[MAX_RELAYS_COUNT];
+PinLocation controlPinLocations[MAX_RELAYS_COUNT];
+PinLocation monitorPinLocations[MAX_RELAYS_COUNT];
+uint16_t controlPinsEnabled = 0;
+uint16_t controlPinsInversed = 0;
+uint16_t monitorPinsEnabled = 0;
+uint16_t monitorPinsInversed = 0;
+uint16_t controlPinsState = 0;
+uint16_t monitorPinsState = 0;
+PinLocation setPinLocations[MAX_RELAYS_COUNT];
+uint16_t setPinsEnabled = 0;
+uint16_t setPinsInversed = 0;
+#ifdef STATIC_RELAYS
+#define CONTROLLED_RELAYS STATIC_CONTROLLED_RELAYS
+#define FIXABLE_RELAYS STATIC_FIXABLE_RELAYS
+#else
+uint16_t controlledRelays = 0;
+uint16_t fixableRelays = 0;
+#define CONTROLLED_RELAYS controlledRelays
+#define FIXABLE_RELAYS fixableRelays
+#endif
+// relays, which reached max state fix tries, are skipped until switched again
+uint16_t stateFixExhausted = 0;
+uint8_t inputPortMasks[PORTS_COUNT];
+uint8_t lastInputPorts[PORTS_COUNT];
+bool inputsSampled = false;
 uint16_t lastControlState = 0;
 uint16_t lastRelayState = 0;
 uint16_t temporaryDisabledControls = 0;
@@ -194,9 +191,25 @@ uint32_t stateFixTimes[MAX_RELAYS_COUNT];
 uint8_t stateFixCount[MAX_RELAYS_COUNT];
 uint32_t lastTimeStampRequsetTime = 0;
 uint16_t lastMonitoringState = 0;
-
-
-void switchRelayState(const RelaySettings &settings, uint8_t i);
+uint16_t stateFixPulsing = 0;
+// contact ready wait ends
+RelayDeadlines<uint16_t> contactDeadlines;
+// state fix pulse ends and min wait delay ends
+RelayDeadlines<uint32_t> stateFixDeadlines;
+// control pins state already seen by checkAndProcessChanges()
+uint16_t seenControlState = 0;
+uint16_t portChangeMillis[PORTS_COUNT];
+
+
+void switchRelayState(uint8_t i);
+
+inline uint8_t getRelaysCount() {
+#ifdef STATIC_RELAYS
+    return STATIC_RELAYS_COUNT;
+#else
+    return settings_.getRelaysCount();
+#endif
+}
 
 bool getLastControlState(uint8_t relayIdx) {
     return CHECK_BIT(lastControlState, relayIdx);
@@ -218,29 +231,114 @@ bool isControlTemporaryDisabled_(uint8_t relayIdx) {
     return CHECK_BIT(temporaryDisabledControls, relayIdx);
 }
 
-bool checkPinState(const PinSettings &pinSettings) {
-    if (pinSettings.isEnabled() && pinSettings.isAllowedPin()) {
-        bool high = digitalRead(pinSettings.getPin()) == HIGH;
-        return pinSettings.isInversed() == !high;
+inline uint8_t toPortIdx(uint8_t port) {
+    switch (port) {
+        case PB:
+            return PORT_B_IDX;
+        case PC:
+            return PORT_C_IDX;
+        default:
+            return PORT_D_IDX;
     }
-    return false;
 }
 
-uint32_t getLocalTimeSec() {
-    return millis() / MILLIS_PER_SECOND;
+void setupPinLocation(const PinSettings &pinSettings, uint8_t relayIdx, PinLocation &location, uint16_t &enabled, uint16_t &inversed) {
+    bool pinEnabled = pinSettings.isEnabled() && pinSettings.isAllowedPin();
+    setBit(enabled, relayIdx, pinEnabled);
+    setBit(inversed, relayIdx, pinSettings.isInversed());
+    if (pinEnabled) {
+        location.portIdx = toPortIdx(digitalPinToPort(pinSettings.getPin()));
+        location.mask = digitalPinToBitMask(pinSettings.getPin());
+    } else {
+        location.portIdx = 0;
+        location.mask = 0;
+    }
+}
+
+uint16_t extractPinsState(const uint8_t ports[PORTS_COUNT], const PinLocation locations[], uint16_t enabled, uint16_t inversed) {
+    uint16_t high = 0;
+    uint8_t relaysCount = settings_.getRelaysCount();
+    for (uint8_t i = 0; i < relaysCount; i++) {
+        const PinLocation &location = locations[i];
+        if (ports[location.portIdx] & location.mask) {
+            high |= (1 << i);
+        }
+    }
+    return (high ^ inversed) & enabled;
+}
+
+// all control and monitor pins are taken from one port snapshot, so they are sampled at the same instant
+void sampleInputs() {
+    uint8_t ports[PORTS_COUNT];
+    halReadPorts(ports);
+    //relay bits are only extracted again when some of the input pins changed
+    uint8_t changed = 0;
+    for (uint8_t i = 0; i < PORTS_COUNT; i++) {
+        changed |= (ports[i] ^ lastInputPorts[i]) & inputPortMasks[i];
+        lastInputPorts[i] = ports[i];
+    }
+    if (changed == 0 && inputsSampled) {
+        return;
+    }
+    inputsSampled = true;
+#ifdef STATIC_RELAYS
+    controlPinsState = (StaticPinsReader<STATIC_CONTROL_PIN>::read(ports) ^ STATIC_CONTROL_INVERSED) & STATIC_CONTROL_PINS;
+    monitorPinsState = (StaticPinsReader<STATIC_MONITOR_PIN>::read(ports) ^ STATIC_MONITOR_INVERSED) & STATIC_MONITOR_PINS;
+#else
+    controlPinsState = extractPinsState(ports, controlPinLocations, controlPinsEnabled, controlPinsInversed);
+    monitorPinsState = extractPinsState(ports, monitorPinLocations, monitorPinsEnabled, monitorPinsInversed);
+#endif
 }
 
-inline void writePinStateForse(const PinSettings &pinSettings, bool switchedOn) {
+inline void writePinStateForse(uint8_t relayIdx, bool switchedOn) {
+#ifdef STATIC_RELAYS
+    StaticSetPinWriter<>::write(relayIdx, switchedOn);
+#else
+    const PinSettings &pinSettings = settings_.getRelaySettingsRef(relayIdx).getSetPinSettings();
     digitalWrite(pinSettings.getPin(), pinSettings.isInversed() != switchedOn ? HIGH : LOW);
+#endif
+}
+
+inline bool isSetPinUsable(uint8_t relayIdx) {
+#ifdef STATIC_RELAYS
+    return CHECK_BIT(STATIC_SET_PINS, relayIdx);
+#else
+    return CHECK_BIT(setPinsEnabled, relayIdx);
+#endif
+}
+
+inline bool isControlPinSwitchByPush(uint8_t relayIdx) {
+#ifdef STATIC_RELAYS
+    return CHECK_BIT(STATIC_SWITCH_BY_PUSH, relayIdx);
+#else
+    return settings_.getRelaySettingsRef(relayIdx).isControlPinSwitchByPush();
+#endif
 }
 
-void setRelayState_(const RelaySettings &relaySettings, bool switchedOn, uint8_t relayIdx, bool internal) {
-    const PinSettings &setPinSettings = relaySettings.getSetPinSettings();
-    if (setPinSettings.isAllowedPin() && setPinSettings.isEnabled()) {
-        writePinStateForse(setPinSettings, switchedOn);
+inline uint8_t getControlPortIdx(uint8_t relayIdx) {
+#ifdef STATIC_RELAYS
+    return StaticPinPort<STATIC_CONTROL_PIN>::get(relayIdx);
+#else
+    return controlPinLocations[relayIdx].portIdx;
+#endif
+}
+
+inline void addSwitchData([[maybe_unused]] uint8_t switchTimeData, [[maybe_unused]] uint32_t time) {
+#ifdef MEM_32KB
+    SwitchHistory::add(switchTimeData, Clock::getMillis(), Clock::getMillisOfSec(), time);
+    EventJournal::add(switchTimeData, time);
+#endif
+}
+
+void setRelayState_(bool switchedOn, uint8_t relayIdx, bool internal) {
+    if (isSetPinUsable(relayIdx)) {
+        writePinStateForse(relayIdx, switchedOn);
         setLastRelayState(relayIdx, switchedOn);
-        stateFixTimes[relayIdx] = getLocalTimeSec();
+        setBit(stateFixPulsing, relayIdx, false);
+        stateFixDeadlines.cancel(1 << relayIdx);
+        stateFixTimes[relayIdx] = Clock::getSec();
         stateFixCount[relayIdx] = 0;
+        setBit(stateFixExhausted, relayIdx, false);
         uint8_t switchTimeData = 0x0f & relayIdx;
         if (switchedOn) {
             switchTimeData |= 0x10;
@@ -249,112 +347,209 @@ void setRelayState_(const RelaySettings &relaySettings, bool switchedOn, uint8_t
             switchTimeData |= 0x20;
         }
         uint32_t time = RelayController::getRemoteTimeSec();
+        addSwitchData(switchTimeData, time);
 #ifdef MEM_32KB
-        stateSwitchDatas[stateSwitchCount++].time = switchTimeData;
-        stateSwitchDatas[stateSwitchCount++].state = switchTimeData;
-#endif
+        EventSignals::add(EK_RELAY_STATE, 1 << relayIdx, switchedOn ? 1 << relayIdx : 0, internal ? 1 << relayIdx : 0);
+#else
         sendSignal(IDC_RELAY_STATE_CHANGED, switchTimeData, time);
+#endif
 
     }
 }
 
-void checkAndFixRelayStates() {
-    for (uint8_t relayIdx = 0; relayIdx < settings_.getRelaysCount(); relayIdx++) {
-        const RelaySettings &relaySettings = settings_.getRelaySettingsRef(relayIdx);
-        const PinSettings &monitoringPinSettings = relaySettings.getMonitorPinSettings();
-        const PinSettings &setPinSettings = relaySettings.getSetPinSettings();
-        bool switchedOnByMonitoring = checkPinState(monitoringPinSettings);
-        bool lastMonitoringSwithedOn = CHECK_BIT(lastMonitoringState, relayIdx);
-        if (switchedOnByMonitoring != lastMonitoringSwithedOn) {
-            setBit(lastMonitoringState, relayIdx, switchedOnByMonitoring);
+// state fix pulse end is polled from processInputs() instead of blocking the loop in delay()
+inline void startStateFixPulse(bool switchedOn, uint8_t relayIdx) {
+    writePinStateForse(relayIdx, !switchedOn);
+    stateFixDeadlines.arm(relayIdx, Clock::getMillis() + settings_.getStateFixSettings().getDelayMillis());
+    setBit(stateFixPulsing, relayIdx, true);
+}
+
+void finishStateFixPulse(bool switchedOn, uint8_t relayIdx) {
+    writePinStateForse(relayIdx, switchedOn);
+    setBit(stateFixPulsing, relayIdx, false);
+    stateFixTimes[relayIdx] = Clock::getSec();
+    stateFixCount[relayIdx]++;
+    uint8_t data = relayIdx & 0xf;
+    if (switchedOn) {
+        data |= 0x10;
+    }
+    sendSignal(IDC_STATE_FIX_TRY, data, stateFixTimes[relayIdx]);
+}
+
+bool checkAndFixRelayStates() {
+    uint16_t monitorChanged = monitorPinsState ^ lastMonitoringState;
+    uint16_t due = stateFixDeadlines.takeExpired(Clock::getMillis());
+    //relays with monitor pin not matching the set state, which still can be fixed and are not waiting
+    uint16_t mismatch = (monitorPinsState ^ lastRelayState) & FIXABLE_RELAYS & ~stateFixExhausted
+            & ~stateFixDeadlines.armed & ~stateFixPulsing;
+    uint16_t attention = monitorChanged | mismatch | (due & stateFixPulsing);
+    if (attention == 0) {
+        return false;
+    }
+    lastMonitoringState = monitorPinsState;
+#ifdef MEM_32KB
+    if (monitorChanged != 0) {
+        EventSignals::add(EK_MONITORING, monitorChanged, monitorPinsState);
+    }
+#endif
+    for (uint8_t relayIdx = 0; attention != 0; relayIdx++, attention >>= 1) {
+        if (!(attention & 1)) {
+            continue;
+        }
+#ifndef MEM_32KB
+        if (CHECK_BIT(monitorChanged, relayIdx)) {
             uint8_t data = relayIdx & 0xf;
-            if (switchedOnByMonitoring) {
+            if (CHECK_BIT(monitorPinsState, relayIdx)) {
                 data |= 0x10;
             }
             sendSignal(IDC_MONITORING_STATE_CHANGED, data, RelayController::getRemoteTimeSec());
         }
+#endif
         bool switchedOn = getLastRelayState(relayIdx);
-        if (
-            switchedOnByMonitoring != switchedOn && monitoringPinSettings.isEnabled()
-            && setPinSettings.isEnabled()
-            && setPinSettings.isAllowedPin()
-            && stateFixCount[relayIdx] < settings_.getStateFixSettings().getMaxCount()
-            && getLocalTimeSec() - stateFixTimes[relayIdx] >= settings_.getStateFixSettings().getMinWaitDelaySec()
-        ) {
-            writePinStateForse(setPinSettings, !switchedOn);
-            delay(settings_.getStateFixSettings().getDelayMillis());
-            writePinStateForse(setPinSettings, switchedOn);
-            stateFixTimes[relayIdx] = getLocalTimeSec();
-            stateFixCount[relayIdx]++;
-            uint8_t data = relayIdx & 0xf;
-            if (switchedOn) {
-                data |= 0x10;
+        if (CHECK_BIT(stateFixPulsing, relayIdx)) {
+            if (CHECK_BIT(due, relayIdx)) {
+                finishStateFixPulse(switchedOn, relayIdx);
+            }
+        } else if (CHECK_BIT(mismatch, relayIdx)) {
+            const StateFixSettings &stateFixSettings = settings_.getStateFixSettings();
+            if (stateFixCount[relayIdx] >= stateFixSettings.getMaxCount()) {
+                setBit(stateFixExhausted, relayIdx, true);
+            } else if (Clock::getSec() - stateFixTimes[relayIdx] >= stateFixSettings.getMinWaitDelaySec()) {
+                startStateFixPulse(switchedOn, relayIdx);
+            } else {
+                stateFixDeadlines.arm(relayIdx, (stateFixTimes[relayIdx] + stateFixSettings.getMinWaitDelaySec()) * MILLIS_PER_SECOND);
             }
-            sendSignal(IDC_STATE_FIX_TRY, data, stateFixTimes[relayIdx]);
         }
     }
+    return true;
 }
 
-void checkAndProcessChanges() {
-    for (uint8_t i = 0; i < settings_.getRelaysCount(); i++) {
-        const RelaySettings &relaySettings = settings_.getRelaySettingsRef(i);
-        const PinSettings &ctrlPinSettings = relaySettings.getControlPinSettings();
-        const PinSettings &setPinSettings = relaySettings.getSetPinSettings();
-        if (ctrlPinSettings.isEnabled() && setPinSettings.isEnabled() && !isControlTemporaryDisabled_(i)) {
-            bool ctrlPinSet = checkPinState(ctrlPinSettings);
-            bool lastSwithedOn = getLastControlState(i);
-            auto &lastWaitData = lastChangeWaitDatas[i];
-            if (
-                (lastSwithedOn != ctrlPinSet || lastWaitData.isWaitStarted()) &&
-                lastWaitData.checkReady(ctrlPinSet)
-                #ifdef MEM_32KB
-                && switchLimiters[i].tryAdd()
-                #endif
-            ) {
-                if (relaySettings.isControlPinSwitchByPush()) {
-                    if (ctrlPinSet) {
-                        switchRelayState(relaySettings, i);
-                    }
-                } else {
-                    setRelayState_(relaySettings, ctrlPinSet, i, true);
+bool checkAndProcessChanges() {
+    //only relays with control pin changed since the last call or with expired contact ready wait are visited
+    uint16_t processed = ~temporaryDisabledControls & CONTROLLED_RELAYS;
+    uint16_t attention = ((controlPinsState ^ seenControlState) | contactDeadlines.takeExpired(Clock::getMillis()))
+            & processed;
+    //changes of temporary disabled relays stay unseen until they are enabled again
+    seenControlState = (seenControlState & ~processed) | (controlPinsState & processed);
+    bool worked = attention != 0;
+    for (uint8_t i = 0; attention != 0; i++, attention >>= 1) {
+        if (!(attention & 1)) {
+            continue;
+        }
+        bool ctrlPinSet = CHECK_BIT(controlPinsState, i);
+        bool lastSwithedOn = getLastControlState(i);
+        auto &lastWaitData = lastChangeWaitDatas[i];
+        bool ready = (lastSwithedOn != ctrlPinSet || lastWaitData.isWaitStarted()) &&
+            lastWaitData.checkReady(ctrlPinSet, portChangeMillis[getControlPortIdx(i)]);
+        if (lastWaitData.isWaitStarted()) {
+            contactDeadlines.arm(i, lastWaitData.getReadyMillis());
+        }
+#ifdef MEM_32KB
+        if (ready) {
+            const SwitchCountingSettings &limit = settings_.getSwitchCountingSettingsRef(i);
+            uint32_t waitMillis = switchLimiters[i].getWaitMillis(limit, Clock::getMillis());
+            if (waitMillis != 0) {
+                //the change stays unprocessed and is checked again (with a new contact ready wait), when the bucket has room
+                //deadlines are 16 bit, longer waits are checked again in steps
+                if (waitMillis > 0x7fff) {
+                    waitMillis = 0x7fff;
                 }
-                setLastControlState(i, ctrlPinSet);
-                uint8_t data = i & 0xf;
+                contactDeadlines.arm(i, (uint16_t) (Clock::getMillis() + waitMillis));
+                ready = false;
+            } else {
+                switchLimiters[i].add(limit, Clock::getMillis());
+            }
+        }
+#endif
+        if (ready) {
+            if (isControlPinSwitchByPush(i)) {
                 if (ctrlPinSet) {
-                    data |= 0x10;
+                    switchRelayState(i);
                 }
-                sendSignal(IDC_CONTROL_STATE_CHANGED, data, RelayController::getRemoteTimeSec());
+            } else {
+                setRelayState_(ctrlPinSet, i, true);
+            }
+            setLastControlState(i, ctrlPinSet);
+#ifdef MEM_32KB
+            EventSignals::add(EK_CONTROL, 1 << i, ctrlPinSet ? 1 << i : 0);
+#else
+            uint8_t data = i & 0xf;
+            if (ctrlPinSet) {
+                data |= 0x10;
             }
+            sendSignal(IDC_CONTROL_STATE_CHANGED, data, RelayController::getRemoteTimeSec());
+#endif
         }
     }
+    return worked;
 }
 
 #ifdef MEM_32KB
-void onControlPinChange() {
-    bool newInterruptPinHigh = digitalRead(settings_.getControlInterruptPin()) == HIGH;
-    sendSerial((uint8_t)(0x7f & (newInterruptPinHigh ? 0x80 : 0x00)));
-    bool changed = false;
-    cli();
-    if (newInterruptPinHigh != lastInterruptPinHigh) {
-        lastInterruptPinHigh = newInterruptPinHigh;
-        changed = true;
-    }
-    sei();
+//pin change interrupts only latch changed pins and the time of the first change, relays are processed in processInputs()
+inline void latchPinChange(uint8_t portIdx, uint8_t value) {
+    uint8_t changed = (value ^ pinChangeLastPorts[portIdx]) & inputPortMasks[portIdx];
+    pinChangeLastPorts[portIdx] = value;
     if (changed) {
-        checkAndProcessChanges();
+        if (pinChangePending[portIdx] == 0) {
+            pinChangeTimes[portIdx] = (uint16_t) millis();
+        }
+        pinChangePending[portIdx] |= changed;
+    }
+}
+
+ISR(PCINT0_vect) {
+    latchPinChange(PORT_B_IDX, PINB);
+}
+
+ISR(PCINT1_vect) {
+    latchPinChange(PORT_C_IDX, PINC);
+}
+
+ISR(PCINT2_vect) {
+    latchPinChange(PORT_D_IDX, PIND);
+}
+
+void setupPinChangeInterrupts() {
+    InterruptLock lock;
+    uint8_t ports[PORTS_COUNT];
+    halReadPorts(ports);
+    for (uint8_t i = 0; i < PORTS_COUNT; i++) {
+        pinChangeLastPorts[i] = ports[i];
+        //change before the interrupts were set up is picked by one full sampling
+        pinChangePending[i] = inputPortMasks[i];
+        pinChangeTimes[i] = (uint16_t) Clock::getMillis();
+    }
+    halEnablePinChangeInterrupts(inputPortMasks);
+}
+
+bool takePinChanges() {
+    bool changed = false;
+    InterruptLock lock;
+    for (uint8_t i = 0; i < PORTS_COUNT; i++) {
+        if (pinChangePending[i]) {
+            changed = true;
+            portChangeMillis[i] = pinChangeTimes[i];
+            pinChangePending[i] = 0;
+        }
     }
+    return changed;
 }
 #endif
 
-void switchRelayState(const RelaySettings &settings, uint8_t i) {
+void switchRelayState(uint8_t i) {
     bool switchedOn = !getLastRelayState(i);
-    setRelayState_(settings, switchedOn, i, true);
+    setRelayState_(switchedOn, i, true);
 }
 
 void RelayController::settingsChanged() {
-    uint8_t relaysCount = settings_.getRelaysCount();
+    uint8_t relaysCount = getRelaysCount();
     for (uint8_t i = 0; i < relaysCount; i++) {
+#ifdef STATIC_RELAYS
+        const RelaySettings relaySettings(STATIC_RELAYS_TABLE[i][STATIC_SET_PIN], STATIC_RELAYS_TABLE[i][STATIC_MONITOR_PIN],
+                                          STATIC_RELAYS_TABLE[i][STATIC_CONTROL_PIN]);
+#else
         const RelaySettings &relaySettings = settings_.getRelaySettingsRef(i);
+#endif
         const PinSettings &setPinSettings = relaySettings.getSetPinSettings();
         if (setPinSettings.isEnabled()) {
             if (setPinSettings.isAllowedPin()) {
@@ -373,9 +568,36 @@ void RelayController::settingsChanged() {
                 pinMode(controlPinSettings.getPin(), controlPinSettings.isInversed() ? INPUT_PULLUP : INPUT);
             }
         }
+        setupPinLocation(controlPinSettings, i, controlPinLocations[i], controlPinsEnabled, controlPinsInversed);
+        setupPinLocation(monitorPinSettings, i, monitorPinLocations[i], monitorPinsEnabled, monitorPinsInversed);
+        setupPinLocation(setPinSettings, i, setPinLocations[i], setPinsEnabled, setPinsInversed);
     }
+    for (uint8_t i = relaysCount; i < MAX_RELAYS_COUNT; i++) {
+        setupPinLocation(PinSettings(), i, setPinLocations[i], setPinsEnabled, setPinsInversed);
+        setupPinLocation(PinSettings(), i, controlPinLocations[i], controlPinsEnabled, controlPinsInversed);
+        setupPinLocation(PinSettings(), i, monitorPinLocations[i], monitorPinsEnabled, monitorPinsInversed);
+    }
+#ifndef STATIC_RELAYS
+    controlledRelays = controlPinsEnabled & setPinsEnabled;
+    fixableRelays = monitorPinsEnabled & setPinsEnabled;
+#endif
+    for (uint8_t &mask : inputPortMasks) {
+        mask = 0;
+    }
+    for (uint8_t i = 0; i < relaysCount; i++) {
+        inputPortMasks[controlPinLocations[i].portIdx] |= controlPinLocations[i].mask;
+        inputPortMasks[monitorPinLocations[i].portIdx] |= monitorPinLocations[i].mask;
+    }
+    inputsSampled = false;
+    contactDeadlines.cancel(0xffff);
+    stateFixDeadlines.cancel(0xffff);
+    //relays, which control state differs from the last processed one, are checked again
+    seenControlState = lastControlState;
+    stateFixExhausted = 0;
 #ifdef MEM_32KB
-    attachInterrupt(digitalPinToInterrupt(settings_.getControlInterruptPin()), onControlPinChange, CHANGE);
+    setupPinChangeInterrupts();
+#else
+    sampleInputs();
 #endif
 }
 
@@ -398,29 +620,56 @@ void RelayController::setup(Settings &settings) {
     startLocalTimeSec = 0;
     remoteTimeStamp = 0;
     for (uint8_t i = 0; i < MAX_RELAYS_COUNT; i++) {
-#ifdef MEM_32KB
-        stateSwitchDatas[i] = 0;
-#endif
         stateFixTimes[i] = 0;
         stateFixCount[i] = 0;
     }
+    stateFixPulsing = 0;
+    stateFixExhausted = 0;
+#ifdef MEM_32KB
+    SwitchHistory::clear();
+    EventJournal::setup();
+#endif
+}
+
+bool RelayController::processInputs() {
+    PHASE_START(LP_INPUT_SCAN, scanStart);
 #ifdef MEM_32KB
-    stateSwitchCount = 0;
+    //inputs are only sampled again when a pin change interrupt reported a change
+    bool worked = takePinChanges();
+    if (worked) {
+        sampleInputs();
+    }
+#else
+    bool worked = false;
+    uint16_t currentMillis = (uint16_t) Clock::getMillis();
+    for (uint16_t &changeMillis : portChangeMillis) {
+        changeMillis = currentMillis;
+    }
+    sampleInputs();
 #endif
+    PHASE_END(LP_INPUT_SCAN, scanStart);
+    PHASE_START(LP_CONTROL, controlStart);
+    worked |= checkAndProcessChanges();
+    PHASE_END(LP_CONTROL, controlStart);
+    PHASE_START(LP_STATE_FIX, stateFixStart);
+    worked |= checkAndFixRelayStates();
+    PHASE_END(LP_STATE_FIX, stateFixStart);
+    return worked;
 }
 
-void RelayController::idle() {
-    if (startLocalTimeSec == 0 && (lastTimeStampRequsetTime - getLocalTimeSec() > REQUEST_TIME_STAMP_INTERVAL)) {
+bool RelayController::maintain() {
+    bool worked = false;
+    if (startLocalTimeSec == 0 && Clock::getMillis() - lastTimeStampRequsetTime >= REQUEST_TIME_STAMP_INTERVAL * MILLIS_PER_SECOND) {
         sendStartSignal(IDC_GET_TIME_STAMP);
-        lastTimeStampRequsetTime = getLocalTimeSec();
+        lastTimeStampRequsetTime = Clock::getMillis();
+        worked = true;
     }
 #ifdef MEM_32KB
-    for (uint8_t i = 0; i < settings_.getRelaysCount(); i++) {
-        switchLimiters[i].update();
-    }
+    worked |= EventJournal::idle();
+    worked |= Telemetry::idle();
+    worked |= EventSignals::idle();
 #endif
-    checkAndProcessChanges();
-    checkAndFixRelayStates();
+    return worked;
 }
 
 bool RelayController::isControlTemporaryDisabled(uint8_t relayIdx) {
@@ -429,20 +678,26 @@ bool RelayController::isControlTemporaryDisabled(uint8_t relayIdx) {
 
 void RelayController::setControlTemporaryDisabled(uint8_t relayIdx, bool disabled) {
     setBit(temporaryDisabledControls, relayIdx, disabled);
+    if (!disabled) {
+        //visited once more, contact ready wait could end while disabled
+        setBit(seenControlState, relayIdx, !CHECK_BIT(controlPinsState, relayIdx));
+    }
 }
 
 bool RelayController::checkRelayMonitoringState(uint8_t relayIdx) {
-    if (relayIdx >= settings_.getRelaysCount()) {
+    if (relayIdx >= getRelaysCount()) {
         return false;
     }
-    return checkPinState(settings_.getRelaySettingsRef(relayIdx).getMonitorPinSettings());
+    sampleInputs();
+    return CHECK_BIT(monitorPinsState, relayIdx);
 }
 
 bool RelayController::checkControlPinState(uint8_t relayIdx) {
-    if (relayIdx >= settings_.getRelaysCount()) {
+    if (relayIdx >= getRelaysCount()) {
         return false;
     }
-    return checkPinState(settings_.getRelaySettingsRef(relayIdx).getControlPinSettings());
+    sampleInputs();
+    return CHECK_BIT(controlPinsState, relayIdx);
 }
 
 bool RelayController::getRelayLastState(uint8_t relayIdx) {
@@ -450,10 +705,57 @@ bool RelayController::getRelayLastState(uint8_t relayIdx) {
 }
 
 void RelayController::setRelayState(uint8_t relayIdx, bool switchedOn) {
-    if (relayIdx >= settings_.getRelaysCount()) {
+    if (relayIdx >= getRelaysCount()) {
         return;
     }
-    setRelayState_(settings_.getRelaySettingsRef(relayIdx), switchedOn, relayIdx, false);
+    setRelayState_(switchedOn, relayIdx, false);
+}
+
+void RelayController::setRelayStates(uint16_t mask, uint16_t switchedOn) {
+    uint8_t relaysCount = getRelaysCount();
+    uint8_t highMasks[PORTS_COUNT] = {0, 0, 0};
+    uint8_t lowMasks[PORTS_COUNT] = {0, 0, 0};
+#ifdef STATIC_RELAYS
+    uint16_t affected = mask & STATIC_SET_PINS;
+    StaticSetPinsMasks<>::collect(affected, switchedOn, lowMasks, highMasks);
+#else
+    uint16_t affected = mask & setPinsEnabled;
+    uint16_t levels = switchedOn ^ setPinsInversed;
+    for (uint8_t i = 0; i < relaysCount; i++) {
+        if (CHECK_BIT(affected, i)) {
+            const PinLocation &location = setPinLocations[i];
+            if (CHECK_BIT(levels, i)) {
+                highMasks[location.portIdx] |= location.mask;
+            } else {
+                lowMasks[location.portIdx] |= location.mask;
+            }
+        }
+    }
+#endif
+    halWritePorts(lowMasks, highMasks);
+
+    lastRelayState = (lastRelayState & ~affected) | (switchedOn & affected);
+    stateFixPulsing &= ~affected;
+    stateFixExhausted &= ~affected;
+    stateFixDeadlines.cancel(affected);
+    uint32_t localTimeSec = Clock::getSec();
+    uint32_t time = totRemoteTimeSec(localTimeSec);
+    for (uint8_t i = 0; i < relaysCount; i++) {
+        if (CHECK_BIT(affected, i)) {
+            stateFixTimes[i] = localTimeSec;
+            stateFixCount[i] = 0;
+            uint8_t switchTimeData = 0x0f & i;
+            if (CHECK_BIT(switchedOn, i)) {
+                switchTimeData |= 0x10;
+            }
+            addSwitchData(switchTimeData, time);
+        }
+    }
+#ifdef MEM_32KB
+    EventSignals::add(EK_RELAY_STATE, affected, switchedOn);
+#else
+    sendSignal(IDC_RELAYS_STATE_CHANGED, affected, (uint16_t)(switchedOn & affected), time);
+#endif
 }
 
 uint32_t RelayController::getRemoteTimeStamp() {
@@ -462,11 +764,14 @@ uint32_t RelayController::getRemoteTimeStamp() {
 
 void RelayController::setRemoteTimeStamp(uint32_t value) {
     remoteTimeStamp = value;
-    startLocalTimeSec = getLocalTimeSec();
+    startLocalTimeSec = Clock::getSec();
+#ifdef MEM_32KB
+    SwitchHistory::resync();
+#endif
 }
 
 uint32_t RelayController::getRemoteTimeSec() {
-    return totRemoteTimeSec(getLocalTimeSec());
+    return totRemoteTimeSec(Clock::getSec());
 }
 
 uint32_t RelayController::totRemoteTimeSec(uint32_t localTimeSec) {
@@ -474,14 +779,14 @@ uint32_t RelayController::totRemoteTimeSec(uint32_t localTimeSec) {
 }
 
 uint8_t RelayController::getFixTryCount(uint8_t relayIdx) {
-    if (relayIdx >= settings_.getRelaysCount()) {
+    if (relayIdx >= getRelaysCount()) {
         return 0;
     }
     return stateFixCount[relayIdx];
 }
 
 uint32_t RelayController::getFixLastTryTime(uint8_t relayIdx) {
-    if (relayIdx >= settings_.getRelaysCount()) {
+    if (relayIdx >= getRelaysCount()) {
         return 0;
     }
     return totRemoteTimeSec(stateFixTimes[relayIdx]);
@@ -493,15 +798,25 @@ uint32_t RelayController::getContactStartWait(uint8_t relayIdx) {
     return  lastChangeWaitDatas[relayIdx].getStartWaitSec();
 }
 
-uint8_t RelayController::getSwitchData(uint32_t **data) {
-    *data = (uint32_t*)stateSwitchDatas;
-    uint8_t stateSwitchCount_ = stateSwitchCount;
-    stateSwitchCount = 0;
-    return stateSwitchCount_;
+void RelayController::clearSwitchCount(uint8_t relayIdx) {
+    switchLimiters[relayIdx].clear(Clock::getMillis());
 }
 
-void RelayController::clearSwitchCount(uint8_t relayIdx) {
-    switchLimiters[relayIdx].clear();
+//pin masks as sampled by the last processInputs()
+uint16_t RelayController::getMonitorStates() {
+    return monitorPinsState;
+}
+
+uint16_t RelayController::getRelayStates() {
+    return lastRelayState;
+}
+
+uint16_t RelayController::getControlStates() {
+    return controlPinsState;
+}
+
+uint16_t RelayController::getTemporaryDisabledControls() {
+    return temporaryDisabledControls;
 }
 
 #endif
@@ -7,25 +7,26 @@
 
 #include "Arduino.h"
 #include "Settings.h"
+#include "SwitchHistory.h"
 
-#define SWITCHES_DATA_BUFFER_SIZE 50
 #define MAX_SWITCH_LIMIT_COUNT 20
 
 
 class RelayController {
 public:
     static void setup(Settings &settings);
-    static void idle();
+    static bool processInputs();
+    static bool maintain();
     static bool isControlTemporaryDisabled(uint8_t relayIdx);
     static void setControlTemporaryDisabled(uint8_t relayIdx, bool disabled);
     static bool checkRelayMonitoringState(uint8_t relayIdx);
     static bool checkControlPinState(uint8_t relayIdx);
     static bool getRelayLastState(uint8_t relayIdx);
     static void setRelayState(uint8_t relayIdx, bool swithedOn);
+    static void setRelayStates(uint16_t mask, uint16_t switchedOn);
     static uint32_t getRemoteTimeStamp() ;
     static void setRemoteTimeStamp(uint32_t remoteTimeStamp);
 #ifdef MEM_32KB
-    static uint8_t getSwitchData(uint32_t **data);
     static uint32_t getContactStartWait(uint8_t relayIdx);
 #endif
     static uint8_t getFixTryCount(uint8_t relayIdx);
@@ -34,6 +35,10 @@ public:
     static uint32_t totRemoteTimeSec(uint32_t localTimeSec);
 #ifdef MEM_32KB
     static void clearSwitchCount(uint8_t relayIdx);
+    static uint16_t getMonitorStates();
+    static uint16_t getRelayStates();
+    static uint16_t getControlStates();
+    static uint16_t getTemporaryDisabledControls();
 #endif
 
 private:
@@ -0,0 +1,116 @@
+#ifndef RELAYCONTROLLER_RINGBUFFER_H
+#define RELAYCONTROLLER_RINGBUFFER_H
+
+#include "Arduino.h"
+#include "Hal.h"
+
+enum RingBufferPolicy : uint8_t {
+    RBP_DROP_NEWEST = 0,
+    RBP_OVERWRITE_OLDEST = 1
+};
+
+//interrupts are disabled only for buffers shared with interrupt handlers
+template<bool INTERRUPT_SAFE>
+struct RingBufferLock : InterruptLock {};
+
+template<>
+struct RingBufferLock<false> {
+    RingBufferLock() {}
+};
+
+/*
+ * Single producer / single consumer ring buffer. When INTERRUPT_SAFE, push() may be called from an interrupt
+ * handler: indexes are single bytes, and the only place where the producer touches the consumer index
+ * (overwriting the oldest item) is done with interrupts disabled, as is the item copy in pop().
+ * Buffers used from the main loop only pass false and take no lock.
+ */
+template<typename T, uint8_t N, bool INTERRUPT_SAFE = true>
+class RingBuffer {
+public:
+    RingBuffer() : head(0), tail(0), overflowCount(0), policy(RBP_DROP_NEWEST) {}
+
+    bool push(const T &item) {
+        RingBufferLock<INTERRUPT_SAFE> lock;
+        uint8_t next = nextIdx(head);
+        bool stored = true;
+        if (next == tail) {
+            overflowCount++;
+            if (policy == RBP_OVERWRITE_OLDEST) {
+                tail = nextIdx(tail);
+            } else {
+                stored = false;
+            }
+        }
+        if (stored) {
+            items[head] = item;
+            head = next;
+        }
+        return stored;
+    }
+
+    bool pop(T &item) {
+        RingBufferLock<INTERRUPT_SAFE> lock;
+        if (tail == head) {
+            return false;
+        }
+        item = items[tail];
+        tail = nextIdx(tail);
+        return true;
+    }
+
+    [[nodiscard]] uint8_t size() const {
+        uint8_t h = head;
+        uint8_t t = tail;
+        return h >= t ? h - t : N + 1 - t + h;
+    }
+
+    [[nodiscard]] uint8_t getFree() const {
+        return N - size();
+    }
+
+    //item at the given distance from the oldest one, the caller checks offset < size()
+    [[nodiscard]] T peek(uint8_t offset) const {
+        uint16_t idx = tail + offset;
+        return items[idx > N ? idx - N - 1 : idx];
+    }
+
+    //drops the given count of the oldest items, the caller checks count <= size()
+    void skip(uint8_t count) {
+        RingBufferLock<INTERRUPT_SAFE> lock;
+        uint16_t idx = tail + count;
+        tail = idx > N ? idx - N - 1 : idx;
+    }
+
+    void clear() {
+        RingBufferLock<INTERRUPT_SAFE> lock;
+        tail = head;
+        overflowCount = 0;
+    }
+
+    [[nodiscard]] uint16_t getOverflowCount() const {
+        return overflowCount;
+    }
+
+    [[nodiscard]] RingBufferPolicy getPolicy() const {
+        return policy;
+    }
+
+    void setPolicy(RingBufferPolicy value) {
+        policy = value;
+    }
+
+private:
+    //one slot is kept free to tell full buffer from empty one
+    T items[N + 1];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint16_t overflowCount;
+    RingBufferPolicy policy;
+
+    static inline uint8_t nextIdx(uint8_t idx) {
+        return idx == N ? 0 : idx + 1;
+    }
+};
+
+
+#endif //RELAYCONTROLLER_RINGBUFFER_H
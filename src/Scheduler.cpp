@@ -0,0 +1,63 @@
+#include "Scheduler.h"
+#include "Clock.h"
+#include "LatencyHistograms.h"
+#include "Hal.h"
+
+
+TaskFunction Scheduler::tasks[ST_COUNT];
+uint16_t Scheduler::runCounts[ST_COUNT];
+uint16_t Scheduler::maxRunMicros[ST_COUNT];
+uint16_t Scheduler::sleepCount = 0;
+
+void Scheduler::setTask(SchedulerTask task, TaskFunction function) {
+    tasks[task] = function;
+}
+
+void Scheduler::run() {
+    Clock::update();
+    PHASE_START(LP_LOOP, roundStart);
+    bool busy = false;
+    //the end of one task is the start of the next one, so time is read once per task
+    uint32_t start = micros();
+    for (uint8_t i = 0; i < ST_COUNT; i++) {
+        if (tasks[i] == nullptr) continue;
+        bool worked = tasks[i]();
+        uint32_t end = micros();
+        uint32_t duration = end - start;
+        start = end;
+        //runs over 65 ms saturate instead of wrapping to small values
+        if (duration > 0xffff) {
+            duration = 0xffff;
+        }
+        if (duration > maxRunMicros[i]) {
+            maxRunMicros[i] = duration;
+        }
+        if (worked) {
+            //counters saturate instead of wrapping to small values
+            if (runCounts[i] != 0xffff) {
+                runCounts[i]++;
+            }
+            busy = true;
+        }
+    }
+    PHASE_END(LP_LOOP, roundStart);
+    if (!busy) {
+        sleep();
+    }
+}
+
+void Scheduler::sleep() {
+    if (sleepCount != 0xffff) {
+        sleepCount++;
+    }
+    //an interrupt that came after the last task check delays the wake up by one millis() tick at most
+    halIdleSleep();
+}
+
+void Scheduler::clearStatistics() {
+    for (uint8_t i = 0; i < ST_COUNT; i++) {
+        runCounts[i] = 0;
+        maxRunMicros[i] = 0;
+    }
+    sleepCount = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef RELAYCONTROLLER_SCHEDULER_H
+#define RELAYCONTROLLER_SCHEDULER_H
+
+#include "Arduino.h"
+
+//tasks in priority order, the first one runs first in every round
+enum SchedulerTask : uint8_t {
+    ST_INPUTS = 0,
+    ST_SERIAL_RX = 1,
+    ST_SERIAL_TX = 2,
+    ST_MAINTENANCE = 3,
+    ST_COUNT = 4
+};
+
+//returns true, when some work was done
+typedef bool (*TaskFunction)();
+
+/*
+ * Cooperative scheduler of the main loop. Every round updates Clock and calls the tasks once in priority
+ * order, so each task waits at most one round. When no task did any work, the CPU goes to idle sleep until
+ * the next interrupt: UART, pin change or the Timer0 millis() tick, which bounds the sleep to about 1 ms,
+ * so polled deadlines are still checked in time.
+ */
+class Scheduler {
+public:
+    static void setTask(SchedulerTask task, TaskFunction function);
+    static void run();
+    [[nodiscard]] static inline uint16_t getRunCount(SchedulerTask task) { return runCounts[task]; }
+    //saturates at 0xffff
+    [[nodiscard]] static inline uint16_t getMaxRunMicros(SchedulerTask task) { return maxRunMicros[task]; }
+    [[nodiscard]] static inline uint16_t getSleepCount() { return sleepCount; }
+    static void clearStatistics();
+
+private:
+    Scheduler() {}
+    static TaskFunction tasks[ST_COUNT];
+    static uint16_t runCounts[ST_COUNT];
+    static uint16_t maxRunMicros[ST_COUNT];
+    static uint16_t sleepCount;
+
+    static void sleep();
+};
+
+
+#endif //RELAYCONTROLLER_SCHEDULER_H
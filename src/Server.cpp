@@ -4,19 +4,29 @@
 
 #include "Server.h"
 #include "utils.h"
+#include "EventJournal.h"
+#include "Scheduler.h"
+#include "Clock.h"
+#include "LatencyHistograms.h"
+#include "Telemetry.h"
+#include "EventSignals.h"
 
-#define MAIN_CODE_POSITION 0
-#define INSTRUCTION_CODE_POSITION (MAIN_CODE_POSITION + 1)
-#define INSTRUCTION_DATA_START_CODE_POSITION (INSTRUCTION_CODE_POSITION + 1)
 #define SETTINGS_SIZE_PER_RELAY 3
 #define SET_RELAY_STATE_DATA_SIZE 2
 #define SET_RELAY_STATE_DATA_COUNT_IN_BYTE (8 / SET_RELAY_STATE_DATA_SIZE)
+#define RELAY_STATES_SIZE(count) (((count) + SET_RELAY_STATE_DATA_COUNT_IN_BYTE - 1) / SET_RELAY_STATE_DATA_COUNT_IN_BYTE)
+//seq u16, state u8, remote time u32
+#define JOURNAL_SENT_RECORD_SIZE 7
 
 
 uint16_t Server::minCycleDuration = 0xffff;
 uint16_t Server::maxCycleDuration = 0;
 uint64_t Server::cyclesCount = 0;
-uint64_t Server::lastCycleTime = 0;
+#ifdef MEM_32KB
+uint32_t RequestId::value = 0;
+bool RequestId::echo = false;
+#endif
+uint32_t Server::lastCycleTime = 0;
 
 void Server::setup() {
     sendSerial((uint64_t)0L);
@@ -25,20 +35,52 @@ void Server::setup() {
     }
 }
 
-void Server::idle() {
+#ifdef MEM_32KB
+void sendCommandCycles(InstructionCode mainCode, InstructionDataCode dataCode, uint32_t ticks) {
+    TxFrame *frame = startSignal(IDC_COMMAND_CYCLES);
+    if (frame != nullptr) {
+        frame->put((uint8_t) mainCode);
+        frame->put((uint8_t) dataCode);
+        frame->put(ticks);
+        TxQueue::commitSignal();
+    }
+}
+#endif
+
+bool Server::receive() {
     updateStatistics();
-    while (readBinaryCommand()) {
+    bool worked = false;
+    //pipelined commands left in the RX buffer are taken in the next rounds, so inputs are not starved
+    for (uint8_t i = 0; i < MAX_COMMANDS_PER_ROUND; i++) {
+        PHASE_START(LP_COMMAND_PARSE, parseStart);
+        bool parsed = readBinaryCommand();
+        PHASE_END(LP_COMMAND_PARSE, parseStart);
+        if (!parsed) break;
+        //the command waits in the command buffer until its response fits without waiting for the UART
+        if (TxQueue::getResponseRoom() < TX_MAX_RESPONSE_SIZE) break;
+        PHASE_START(LP_COMMAND_EXECUTE, executeStart);
         processBinaryInstruction();
+#ifdef MEM_32KB
+        uint32_t ticks = PHASE_END(LP_COMMAND_EXECUTE, executeStart);
+        if (commandCyclesSignals) {
+            sendCommandCycles(cmdMainCode, cmdDataCode, ticks);
+        }
+#else
+        PHASE_END(LP_COMMAND_EXECUTE, executeStart);
+#endif
+        worked = true;
     }
+    return worked;
 }
 
 void Server::updateStatistics() {
-    uint64_t currTime = millis();
-    uint16_t cycleDuration = currTime - lastCycleTime;
+    uint32_t currTime = Clock::getMillis();
+    auto cycleDuration = (uint16_t) (currTime - lastCycleTime);
     lastCycleTime = currTime;
     if (cycleDuration > maxCycleDuration) {
         maxCycleDuration = cycleDuration;
-    } else if (cycleDuration < minCycleDuration) {
+    }
+    if (cycleDuration < minCycleDuration) {
         minCycleDuration = cycleDuration;
     }
     cyclesCount++;
@@ -56,28 +98,44 @@ void sendError(ErrorCode code) {
     sendSerial(code);
 }
 
+void sendError(ErrorCode code, InstructionDataCode dataCode) {
+    sendError(code);
+    sendResponseCode(dataCode);
+}
+
 void sendSuccess(InstructionDataCode code) {
     sendSerial(IC_NONE);
     sendSerial(IC_SUCCESS);
-    sendSerial(code);
+    sendResponseCode(code);
 }
 
 void sendSuccess(InstructionDataCode code, uint8_t value) {
-    sendSerial(IC_NONE);
-    sendSerial(IC_SUCCESS);
-    sendSerial(code);
+    sendSuccess(code);
     sendSerial(value);
 }
 
+//codes from E_UNDEFINED_CODE up carry a successful result value
+void sendResult(ErrorCode result, InstructionDataCode code) {
+    if (result < E_UNDEFINED_CODE) {
+        sendError(result, code);
+    } else {
+        sendSuccess(code, result);
+    }
+}
+
 bool Server::readBinaryCommand() {
     if (commandParsed && !commandPocessed) {
         return true;
     }
+    //the first byte is checked only when it is there already, a frame start arriving later is not taken for a legacy command
     uint8_t available = Serial.available();
+    if (lastPacketSize == 0 && (frameReadState != FRS_START || frameResync || (available && Serial.peek() == FRAME_START))) {
+        return readFramedCommand();
+    }
     if (!available) {
         return false;
     }
-    auto currTime = (uint32_t) millis();
+    auto currTime = Clock::getMillis();
     bool commandReady = lastPacketSize > 0 && lastPacketTime > 0 &&  (available - lastPacketSize) == 0 && (currTime - lastPacketTime) > MAX_COMMAND_READ_TIME;
     if (available != lastPacketSize) {
         lastPacketTime = currTime;
@@ -95,61 +153,353 @@ bool Server::readBinaryCommand() {
         return false;
     }
     commandParsed = false;
-    available = Serial.available();
-    if (available == 0) {
+    if (!Serial.available()) {
         sendError(E_COMMAND_EMPTY);
         return false;
     }
-    if (available > CMD_BUFF_SIZE) {
-        sendError(E_COMMAND_SIZE_OVERFLOW);
-        Serial.read();
-        //next byte is instruction code
-        sendSerial((uint8_t)Serial.read());
-        clearSerial();
+    startDecode();
+    while (Serial.available()) {
+        decodeCmdByte((uint8_t) Serial.read());
+    }
+    startCommand(false);
+    return acceptCommand();
+}
+
+//takes the bytes already received and decodes them, the command is started only after its CRC is checked
+bool Server::readFramedCommand() {
+    auto currTime = Clock::getMillis();
+    if (frameReadState != FRS_START && !Serial.available() && currTime - lastFrameByteTime > MAX_FRAME_BYTE_WAIT_TIME) {
+        resetFrame(true);
+        sendError(E_FRAME_INCOMPLETE);
         return false;
     }
-    Serial.readBytes(cmdBuff, available);
-    cmdBuffSize = available;
-    bool commandUnrecognized;
-    if (cmdBuffSize < 2) {
-        commandUnrecognized = true;
-    } else {
-        uint8_t firstCode = cmdBuff[MAIN_CODE_POSITION];
+    while (Serial.available()) {
+        auto value = (uint8_t) Serial.read();
+        lastFrameByteTime = currTime;
+        switch (frameReadState) {
+            case FRS_START:
+                //while resynchronizing everything up to the next frame start is dropped
+                if (value == FRAME_START) {
+                    frameResync = false;
+                    frameReadState = FRS_LENGTH;
+                }
+                break;
+            case FRS_LENGTH:
+                if (value == 0) {
+                    resetFrame(false);
+                    sendError(E_COMMAND_EMPTY);
+                } else {
+                    frameLength = value;
+                    frameCrc = updateFrameCrc(0, value);
+                    framePos = 0;
+                    frameReadState = FRS_PAYLOAD;
+                    startDecode();
+                }
+                break;
+            case FRS_PAYLOAD:
+                decodeCmdByte(value);
+                framePos++;
+                frameCrc = updateFrameCrc(frameCrc, value);
+                if (framePos == frameLength) {
+                    frameReadState = FRS_CRC;
+                }
+                break;
+            case FRS_CRC:
+                if (value != frameCrc) {
+                    resetFrame(true);
+                    sendError(E_FRAME_CRC_MISMATCH);
+                    break;
+                }
+                resetFrame(false);
+                startCommand(true);
+                return acceptCommand();
+        }
+    }
+    return false;
+}
+
+void Server::resetFrame(bool resync) {
+    frameReadState = FRS_START;
+    frameResync = resync;
+}
+
+constexpr uint16_t fields(CommandField first = CF_END, CommandField second = CF_END, CommandField third = CF_END,
+                          CommandField fourth = CF_END, CommandField fifth = CF_END) {
+    return first | second << CF_BITS | third << 2 * CF_BITS | fourth << 3 * CF_BITS | fifth << 4 * CF_BITS;
+}
+
+// fields of the command after its header
+uint16_t commandFields(InstructionCode mainCode, InstructionDataCode code) {
+    switch (mainCode) {
+        case IC_READ:
+            switch (code) {
+                case IDC_RELAY_STATE:
 #ifdef MEM_32KB
-        commandUnrecognized = firstCode != IC_READ && firstCode != IC_SET && firstCode != IC_COMMAND;
-#else
-        commandUnrecognized = firstCode != IC_READ && firstCode != IC_SET;
+                case IDC_RELAY_DISABLED_TEMP:
+                case IDC_RELAY_SWITCHED_ON:
+                case IDC_RELAY_MONITOR_ON:
+                case IDC_RELAY_CONTROL_ON:
+                case IDC_SWITCH_COUNTING_SETTINGS:
+                case IDC_SCENE:
+                case IDC_LATENCY_HISTOGRAM:
+#endif
+                    return fields(CF_U8);
+#ifdef MEM_32KB
+                case IDC_JOURNAL:
+                    return fields(CF_U16, CF_U8);
+#endif
+                default:
+                    return fields();
+            }
+        case IC_SET:
+            switch (code) {
+                case IDC_SETTINGS:
+                    return fields(CF_RELAY_SETTINGS);
+                case IDC_STATE:
+                    return fields(CF_RELAY_STATES);
+                case IDC_ID:
+                case IDC_REMOTE_TIMESTAMP:
+                    return fields(CF_U32);
+                case IDC_STATE_FIX_SETTINGS:
+                    return fields(CF_U16, CF_U8, CF_U8, CF_U16);
+                case IDC_RELAY_STATE:
+#ifdef MEM_32KB
+                case IDC_RELAY_DISABLED_TEMP:
+                case IDC_RELAY_SWITCHED_ON:
+                case IDC_SWITCH_DATA:
+                case IDC_COMMAND_CYCLES:
+#endif
+                    return fields(CF_U8);
+#ifdef MEM_32KB
+                case IDC_ALL:
+                    //the second byte is the deprecated control interrupt pin
+                    return fields(CF_U8, CF_U32, CF_U8, CF_RELAY_SETTINGS, CF_RELAY_STATES);
+                case IDC_SWITCH_COUNTING_SETTINGS:
+                    return fields(CF_U8, CF_U16, CF_U8);
+                case IDC_SCENE:
+                    return fields(CF_U8, CF_U16, CF_U16);
+                case IDC_TELEMETRY:
+                    return fields(CF_U8, CF_U16);
+#endif
+                default:
+                    return fields();
+            }
+#ifdef MEM_32KB
+        case IC_COMMAND:
+            switch (code) {
+                case IDC_CLEAR_SWITCH_COUNT:
+                case IDC_APPLY_SCENE:
+                    return fields(CF_U8);
+                case IDC_BATCH:
+                    return fields(CF_U8, CF_U8, CF_BATCH_ITEMS);
+                default:
+                    return fields();
+            }
 #endif
+        default:
+            return fields();
     }
-    if (commandUnrecognized) {
-        sendError(E_INSTRUCTION_UNRECOGIZED);
-        sendSerial(cmdBuff[INSTRUCTION_CODE_POSITION]);
-        return false;
+}
+
+void Server::startDecode() {
+    cmdHeaderPos = 0;
+    cmdMainCode = IC_UNKNOWN;
+    cmdDataCode = IDC_UNKNOWN;
+    startFields(fields());
+#ifdef MEM_32KB
+    cmdId = 0;
+    batchSize = 0;
+    batchOverflow = false;
+#endif
+}
+
+void Server::decodeCmdByte(uint8_t value) {
+    if (cmdHeaderPos == CMD_HEADER_SIZE) {
+        decodeField(value);
+        return;
     }
+    switch (cmdHeaderPos++) {
+        case 0:
+            cmdMainCode = (InstructionCode) value;
+            break;
+        case 1:
+            cmdDataCode = (InstructionDataCode) value;
+            startFields(commandFields(cmdMainCode, cmdDataCode));
+            break;
+#ifdef MEM_32KB
+        default:
+            cmdId = (cmdId << 8) | value;
+            break;
+#endif
+    }
+}
+
+void Server::startFields(uint16_t fields) {
+    cmdFields = fields;
+    cmdFieldPos = 0;
+    cmdFieldValue = 0;
+    cmdArgsSize = 0;
+    cmdValuesCount = 0;
+    cmdValuesPos = 0;
+    cmdRelaySettingsSize = 0;
+    cmdRelayStatesSize = 0;
+    cmdRelayStatesMask = 0;
+    cmdRelaysSwitchedOn = 0;
+    cmdRelaysDisabled = 0;
+}
+
+//bytes after the last field are ignored, so are the bytes after a relay count too big to be split
+void Server::decodeField(uint8_t value) {
+    cmdArgsSize++;
+    auto field = (CommandField) (cmdFields & CF_BITS_MASK);
+    uint8_t pos = cmdFieldPos++;
+    switch (field) {
+        case CF_U8:
+        case CF_U16:
+        case CF_U32:
+            cmdFieldValue = (cmdFieldValue << 8) | value;
+            if (cmdFieldPos == 1 << (field - CF_U8)) {
+                if (cmdValuesCount < MAX_COMMAND_VALUES) {
+                    cmdValues[cmdValuesCount++] = cmdFieldValue;
+                }
+                nextField();
+            }
+            break;
+        case CF_RELAY_SETTINGS:
+            cmdRelaySettingsSize++;
+            if (pos == 0) {
+                cmdRelaySettingsCount = value;
+                if (value >= MAX_RELAYS_COUNT) {
+                    cmdFields = CF_END;
+                } else if (value == 0) {
+                    nextField();
+                }
+                break;
+            }
+            cmdFieldValue = (cmdFieldValue << 8) | value;
+            if (pos % SETTINGS_SIZE_PER_RELAY == 0) {
+                cmdRelaySettings[pos / SETTINGS_SIZE_PER_RELAY - 1] = RelaySettings(
+                        cmdFieldValue >> 16, cmdFieldValue >> 8, cmdFieldValue);
+                cmdFieldValue = 0;
+                if (pos == cmdRelaySettingsCount * SETTINGS_SIZE_PER_RELAY) {
+                    nextField();
+                }
+            }
+            break;
+        case CF_RELAY_STATES:
+            cmdRelayStatesSize++;
+            if (pos == 0) {
+                cmdRelayStatesCount = value;
+                if (value >= MAX_RELAYS_COUNT) {
+                    cmdFields = CF_END;
+                } else if (value == 0) {
+                    nextField();
+                }
+                break;
+            }
+            for (uint8_t i = (pos - 1) * SET_RELAY_STATE_DATA_COUNT_IN_BYTE, shift = 0;
+                 i < cmdRelayStatesCount && shift < 8; i++, shift += SET_RELAY_STATE_DATA_SIZE) {
+                setBit(cmdRelayStatesMask, i, true);
+                setBit(cmdRelaysSwitchedOn, i, CHECK_BIT(value, shift));
+                setBit(cmdRelaysDisabled, i, CHECK_BIT(value, shift + 1));
+            }
+            if (pos == RELAY_STATES_SIZE(cmdRelayStatesCount)) {
+                nextField();
+            }
+            break;
+#ifdef MEM_32KB
+        case CF_BATCH_ITEMS:
+            if (batchSize < BATCH_BUFF_SIZE) {
+                batchBuff[batchSize++] = value;
+            } else {
+                batchOverflow = true;
+            }
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+void Server::nextField() {
+    cmdFields >>= CF_BITS;
+    cmdFieldPos = 0;
+    cmdFieldValue = 0;
+}
+
+void Server::startCommand(bool framed) {
+    cmdFramed = framed;
     commandParsed = true;
     commandPocessed = false;
+#ifdef MEM_32KB
+    //until the id is read, responses to framed commands carry id 0
+    RequestId::set(0, framed);
+#endif
+}
+
+bool Server::acceptCommand() {
+    auto mainCode = cmdMainCode;
+#ifdef MEM_32KB
+    bool recognized = mainCode == IC_READ || mainCode == IC_SET || mainCode == IC_COMMAND;
+#else
+    bool recognized = mainCode == IC_READ || mainCode == IC_SET;
+#endif
+    if (cmdHeaderPos < 2 || !recognized) {
+        finishCmdRead();
+        sendError(E_INSTRUCTION_UNRECOGIZED, cmdDataCode);
+        finishCommand();
+        return false;
+    }
     return true;
 }
 
+//unread fields of the command are dropped
+void Server::finishCmdRead() {
+    cmdValuesPos = cmdValuesCount;
+    commandParsed = false;
+}
+
 void Server::processBinaryInstruction() {
-    uint8_t mainCode = cmdBuff[MAIN_CODE_POSITION];
-    cmdBuffCurrPos = INSTRUCTION_DATA_START_CODE_POSITION;
     ErrorCode result;
+    auto code = cmdDataCode;
 #ifdef MEM_32KB
-    uint32_t id;
-    result = readUint32FromCommandBuffer(id);
-    if (result != OK) {
-        sendError(result);
+    if (batchPending) {
+        if (continueBatch()) {
+            finishCmdRead();
+            finishCommand();
+        }
+        return;
+    }
+    if (cmdHeaderPos < CMD_HEADER_SIZE) {
+        finishCmdRead();
+        sendError(E_REQUEST_DATA_NO_VALUE, code);
+        finishCommand();
+        return;
+    }
+    RequestId::set(cmdId, cmdFramed);
+#endif
+    result = executeInstruction(cmdMainCode, code);
+#ifdef MEM_32KB
+    if (batchPending) {
+        //the rest of the items is executed in the next rounds
         return;
     }
 #endif
-    auto code = (InstructionDataCode) cmdBuff[INSTRUCTION_CODE_POSITION];
+    finishCmdRead();
+    if (result != OK) {
+        sendResult(result, code);
+    }
+    finishCommand();
+}
+
+ErrorCode Server::executeInstruction(InstructionCode mainCode, InstructionDataCode code) {
+    ErrorCode result;
     switch (mainCode) {
         case IC_READ:
             result = processBinaryRead(code);
             break;
         case IC_SET:
-            if (cmdBuffSize < 3) {
+            if (cmdArgsSize == 0) {
                 result = E_REQUEST_DATA_NO_VALUE;
                 break;
             }
@@ -160,6 +510,11 @@ void Server::processBinaryInstruction() {
             break;
 #ifdef MEM_32KB
         case IC_COMMAND:
+            if (code == IDC_BATCH) {
+                //batch sends its response itself
+                result = processBatch();
+                break;
+            }
             result = processBinaryCommand(code);
             if (result == OK) {
                 sendSuccess(code);
@@ -170,15 +525,14 @@ void Server::processBinaryInstruction() {
             result = E_INSTRUCTION_UNRECOGIZED;
             break;
     }
-    if (result != OK) {
-        if (result < E_UNDEFINED_CODE) {
-            sendError(result);
-            sendSerial(code);
-        } else {
-            sendSuccess(code, result);
-        }
-    }
+    return result;
+}
+
+void Server::finishCommand() {
     commandPocessed = true;
+#ifdef MEM_32KB
+    RequestId::clear();
+#endif
 }
 
 ErrorCode Server::processBinaryRead(InstructionDataCode code) {
@@ -209,18 +563,16 @@ ErrorCode Server::processBinaryRead(InstructionDataCode code) {
             return sendRelayMonitorOn();
         case IDC_RELAY_CONTROL_ON:
             return sendRelayControlOn();
-            case IDC_INTERRUPT_PIN:
-            return sendInterruptPin();
+        case IDC_INTERRUPT_PIN:
+            return E_INSTRUCTION_DEPRECATED;
         case IDC_SWITCH_COUNTING_SETTINGS:
             return sendSwitchCountingSettings();
+        case IDC_SCENE:
+            return sendScene();
 #endif
         case IDC_VERSION:
             sendStartResponse(IDC_VERSION);
-#ifdef MEM_32KB
-            sendSerial((uint8_t)2);
-#else
-            sendSerial((uint8_t)1);
-#endif
+            sendSerial((uint8_t) PROTOCOL_VERSION);
             return OK;
         case IDC_CURRENT_TIME:
             sendStartResponse(IDC_CURRENT_TIME);
@@ -231,6 +583,14 @@ ErrorCode Server::processBinaryRead(InstructionDataCode code) {
             return sendSwitchData();
         case IDC_CONTACT_WAIT_DATA:
             return sendContactWaitData();
+        case IDC_JOURNAL:
+            return sendJournal();
+        case IDC_LATENCY_HISTOGRAM:
+            return sendLatencyHistogram();
+        case IDC_TELEMETRY:
+            return sendTelemetrySubscription();
+        case IDC_MERGED_EVENTS:
+            return sendMergedEvents();
 #endif
         case IDC_FIX_DATA:
             return sendFixData();
@@ -238,9 +598,13 @@ ErrorCode Server::processBinaryRead(InstructionDataCode code) {
             sendStartResponse(IDC_GET_CYCLES_STATISTICS);
             sendSerial(minCycleDuration);
             sendSerial(maxCycleDuration);
-            sendSerial((uint16_t)(millis() / cyclesCount));
+            sendSerial((uint16_t)(Clock::getMillis() / cyclesCount));
             sendSerial(cyclesCount);
             return OK;
+        case IDC_TX_QUEUE_STATISTICS:
+            return sendTxQueueStatistics();
+        case IDC_SCHEDULER_STATISTICS:
+            return sendSchedulerStatistics();
         default:
             return E_UNDEFINED_OPERATION;
     }
@@ -268,9 +632,17 @@ ErrorCode Server::processBinarySet(InstructionDataCode code) {
         case IDC_RELAY_SWITCHED_ON:
             return saveRelaySwitchedOn();
         case IDC_INTERRUPT_PIN:
-            return saveInterruptPin();
+            return E_INSTRUCTION_DEPRECATED;
         case IDC_SWITCH_COUNTING_SETTINGS:
             return saveSwitchCountingSettings();
+        case IDC_SCENE:
+            return saveScene();
+        case IDC_SWITCH_DATA:
+            return saveSwitchDataPolicy();
+        case IDC_COMMAND_CYCLES:
+            return saveCommandCyclesSignals();
+        case IDC_TELEMETRY:
+            return saveTelemetrySubscription();
 #endif
         default:
             return E_UNDEFINED_OPERATION;
@@ -281,6 +653,133 @@ ErrorCode Server::processBinaryCommand(InstructionDataCode code) {
     switch (code) {
         case IDC_CLEAR_SWITCH_COUNT:
             return clearSwitchCount();
+        case IDC_APPLY_SCENE:
+            return applyScene();
+        case IDC_COMMIT_SETTINGS:
+            settings.commit();
+            return OK;
+        default:
+            return E_UNDEFINED_OPERATION;
+    }
+}
+
+ErrorCode Server::processBatch() {
+    uint8_t flags = 0;
+    ErrorCode res = readUint8FromCmd(flags);
+    if (res != OK) return res;
+    uint8_t count = 0;
+    res = readUint8FromCmd(count);
+    if (res != OK) return res;
+    if (batchOverflow) return E_COMMAND_SIZE_OVERFLOW;
+    batchPos = 0;
+    batchAtomic = flags & BATCH_ATOMIC_FLAG;
+    if (batchAtomic) {
+        settings.snapshot(batchSnapshot);
+    }
+    sendStartResponse(IDC_BATCH);
+    sendSerial(count);
+    //item responses go without the command id, it is sent once in the batch header
+    RequestId::clear();
+    batchResult = OK;
+    batchItemsLeft = count;
+    batchPending = true;
+    TxQueue::holdSignals(true);
+    continueBatch();
+    return OK;
+}
+
+//items are executed as long as their responses fit, returns true when the batch is finished
+bool Server::continueBatch() {
+    while (batchItemsLeft > 0) {
+        if (TxQueue::getResponseRoom() < TX_MAX_RESPONSE_SIZE) {
+            return false;
+        }
+        ErrorCode res = processBatchItem(batchAtomic, batchResult != OK);
+        batchItemsLeft--;
+        if (batchAtomic && batchResult == OK && res != OK && res < E_UNDEFINED_CODE) {
+            batchResult = res;
+        }
+    }
+    if (batchAtomic && batchResult != OK) {
+        settings.restore(batchSnapshot);
+    }
+    sendSerial(batchResult);
+    TxQueue::holdSignals(false);
+    batchPending = false;
+    return true;
+}
+
+ErrorCode Server::processBatchItem(bool atomic, bool skip) {
+    uint8_t mainCode = IC_UNKNOWN;
+    uint8_t code = IDC_UNKNOWN;
+    uint8_t length = 0;
+    ErrorCode res = readBatchByte(mainCode);
+    if (res == OK) {
+        res = readBatchByte(code);
+    }
+    if (res == OK) {
+        res = readBatchByte(length);
+    }
+    if (res == OK && length > batchSize - batchPos) {
+        res = E_COMMAND_SIZE_OVERFLOW;
+    }
+    if (res != OK) {
+        //the rest of the payload can not be split into items any more
+        batchPos = batchSize;
+        sendError(skip ? E_BATCH_ITEM_SKIPPED : res, (InstructionDataCode) code);
+        return res;
+    }
+    const uint8_t *item = batchBuff + batchPos;
+    batchPos += length;
+    if (skip) {
+        res = E_BATCH_ITEM_SKIPPED;
+    } else if (mainCode == IC_COMMAND && code == IDC_BATCH) {
+        res = E_UNDEFINED_OPERATION;
+    } else if (atomic && !isSettingsInstruction((InstructionCode) mainCode, (InstructionDataCode) code)) {
+        res = E_BATCH_ITEM_NOT_ATOMIC;
+    } else {
+        //the item is decoded like a command without header
+        startFields(commandFields((InstructionCode) mainCode, (InstructionDataCode) code));
+        for (uint8_t i = 0; i < length; i++) {
+            decodeField(item[i]);
+        }
+        res = executeInstruction((InstructionCode) mainCode, (InstructionDataCode) code);
+    }
+    //an item answered already is not answered again
+    if (res != OK) {
+        sendResult(res, (InstructionDataCode) code);
+    }
+    return res;
+}
+
+ErrorCode Server::readBatchByte(uint8_t &result) {
+    if (batchPos == batchSize) return E_REQUEST_DATA_NO_VALUE;
+    result = batchBuff[batchPos++];
+    return OK;
+}
+
+bool Server::isSettingsInstruction(InstructionCode mainCode, InstructionDataCode code) {
+    if (mainCode == IC_READ) {
+        //reads, which consume what they send, can not be rolled back
+        switch (code) {
+            case IDC_SWITCH_DATA:
+            case IDC_LATENCY_HISTOGRAM:
+            case IDC_MERGED_EVENTS:
+                return false;
+            default:
+                return true;
+        }
+    }
+    if (mainCode != IC_SET) return false;
+    switch (code) {
+        case IDC_SETTINGS:
+        case IDC_ID:
+        case IDC_STATE_FIX_SETTINGS:
+        case IDC_SWITCH_COUNTING_SETTINGS:
+        case IDC_SCENE:
+            return true;
+        default:
+            return false;
     }
 }
 #endif
@@ -301,29 +800,35 @@ void Server::sendSettings(bool addResultCode) {
 
 uint8_t Server::saveSettings() {
     uint8_t relayCount = 0;
-    ErrorCode res = readRelayCountFromCmdBuff(relayCount);
+    uint8_t res = readRelaySettingsFromCmd(relayCount);
     if (res != OK) return res;
-    if (relayCount * SETTINGS_SIZE_PER_RELAY + cmdBuffCurrPos > cmdBuffSize) return E_RELAY_COUNT_AND_DATA_MISMATCH;
-    RelaySettings relaySettings[relayCount];
+#ifdef STATIC_RELAYS
+    return E_UNDEFINED_OPERATION;
+#else
+    uint8_t savedCount = settings.saveRelaySettings(cmdRelaySettings, relayCount);
+    return savedCount | E_UNDEFINED_CODE;
+#endif
+}
+
+//checks the decoded settings block, the settings are in cmdRelaySettings
+uint8_t Server::readRelaySettingsFromCmd(uint8_t &relayCount) {
+    if (cmdRelaySettingsSize == 0) return E_REQUEST_DATA_NO_VALUE;
+    if (cmdRelaySettingsCount >= MAX_RELAYS_COUNT) return E_RELAY_COUNT_OVERFLOW;
+    relayCount = cmdRelaySettingsCount;
+    if (relayCount * SETTINGS_SIZE_PER_RELAY > cmdRelaySettingsSize - 1) return E_RELAY_COUNT_AND_DATA_MISMATCH;
     for (uint8_t i = 0; i < relayCount; i++) {
-        relaySettings[i] = RelaySettings(
-            cmdBuff[cmdBuffCurrPos],
-            cmdBuff[cmdBuffCurrPos + 1],
-            cmdBuff[cmdBuffCurrPos + 2]
-        );
-        cmdBuffCurrPos += 3;
-        if (!relaySettings[i].getSetPinSettings().isAllowedPin()){
-            return E_RELAY_NOT_ALLOWED_PIN_USED | relaySettings[i].getSetPinSettings().getPin();
+        const RelaySettings &relay = cmdRelaySettings[i];
+        if (!relay.getSetPinSettings().isAllowedPin()){
+            return E_RELAY_NOT_ALLOWED_PIN_USED | relay.getSetPinSettings().getPin();
         }
-        if (!relaySettings[i].getMonitorPinSettings().isAllowedPin()){
-            return E_RELAY_NOT_ALLOWED_PIN_USED | relaySettings[i].getMonitorPinSettings().getPin();
+        if (!relay.getMonitorPinSettings().isAllowedPin()){
+            return E_RELAY_NOT_ALLOWED_PIN_USED | relay.getMonitorPinSettings().getPin();
         }
-        if (!relaySettings[i].getControlPinSettings().isAllowedPin()){
-            return E_RELAY_NOT_ALLOWED_PIN_USED | relaySettings[i].getControlPinSettings().getPin();
+        if (!relay.getControlPinSettings().isAllowedPin()){
+            return E_RELAY_NOT_ALLOWED_PIN_USED | relay.getControlPinSettings().getPin();
         }
     }
-    uint8_t savedCount = settings.saveRelaySettings(relaySettings, relayCount);
-    return savedCount | E_UNDEFINED_CODE;
+    return OK;
 }
 
 ErrorCode Server::sendState(bool addResultCode) {
@@ -346,21 +851,35 @@ ErrorCode Server::sendState(bool addResultCode) {
 }
 
 ErrorCode Server::saveState() {
-    uint8_t providedCount = 0;
-    ErrorCode res = readRelayCountFromCmdBuff(providedCount);
+    uint16_t mask = 0;
+    uint16_t switchedOn = 0;
+    uint16_t disabled = 0;
+    ErrorCode res = readRelayStatesFromCmd(settings.getRelaysCount(), mask, switchedOn, disabled);
     if (res != OK) return res;
-    if (providedCount != settings.getRelaysCount()) return E_RELAY_COUNT_AND_DATA_MISMATCH;
-    if (cmdBuffSize < cmdBuffCurrPos + SET_RELAY_STATE_DATA_SIZE * providedCount + 1) return E_REQUEST_DATA_NO_VALUE;
-    uint8_t* data = cmdBuff + cmdBuffCurrPos;
-    for (uint8_t i = 0; i < providedCount; i++) {
-        uint8_t command = data[i / SET_RELAY_STATE_DATA_COUNT_IN_BYTE];
-        uint8_t shift = (i % SET_RELAY_STATE_DATA_COUNT_IN_BYTE) * SET_RELAY_STATE_DATA_SIZE;
-        RelayController::setRelayState(i, CHECK_BIT(command, shift));
-        RelayController::setControlTemporaryDisabled(i, CHECK_BIT(command, shift + 1));
-    }
+    applyRelayStates(mask, switchedOn, disabled);
+    return OK;
+}
+
+ErrorCode Server::readRelayStatesFromCmd(uint8_t relayCount, uint16_t &mask, uint16_t &switchedOn, uint16_t &disabled) {
+    if (cmdRelayStatesSize == 0) return E_REQUEST_DATA_NO_VALUE;
+    if (cmdRelayStatesCount >= MAX_RELAYS_COUNT) return E_RELAY_COUNT_OVERFLOW;
+    if (cmdRelayStatesCount != relayCount) return E_RELAY_COUNT_AND_DATA_MISMATCH;
+    if (cmdRelayStatesSize - 1 < RELAY_STATES_SIZE(relayCount)) return E_REQUEST_DATA_NO_VALUE;
+    mask = cmdRelayStatesMask;
+    switchedOn = cmdRelaysSwitchedOn;
+    disabled = cmdRelaysDisabled;
     return OK;
 }
 
+void Server::applyRelayStates(uint16_t mask, uint16_t switchedOn, uint16_t disabled) {
+    for (uint8_t i = 0; i < MAX_RELAYS_COUNT; i++) {
+        if (CHECK_BIT(mask, i)) {
+            RelayController::setControlTemporaryDisabled(i, CHECK_BIT(disabled, i));
+        }
+    }
+    RelayController::setRelayStates(mask, switchedOn);
+}
+
 ErrorCode Server::sendId(bool addResultCode) {
     if (addResultCode) {
         sendStartResponse(IDC_ID);
@@ -370,9 +889,8 @@ ErrorCode Server::sendId(bool addResultCode) {
 }
 
 ErrorCode Server::saveId() {
-    if (cmdBuffSize < cmdBuffCurrPos + sizeof(uint32_t)) return E_REQUEST_DATA_NO_VALUE;
     uint32_t controllerId = 0;
-    ErrorCode res = readUint32FromCommandBuffer(controllerId);
+    ErrorCode res = readUint32FromCmd(controllerId);
     if (res != OK) return res;
     settings.saveControllerId(controllerId);
     return OK;
@@ -390,21 +908,54 @@ ErrorCode Server::sendStateFixSettings() {
 
 ErrorCode Server::saveStateFixSettings() {
     uint16_t delayMillis = 0;
-    ErrorCode res = readUint16FromCmdBuff(delayMillis);
+    ErrorCode res = readUint16FromCmd(delayMillis);
     if (res != OK) return res;
     uint8_t maxCount = 0;
-    res = readUint8FromCmdBuff(maxCount);
+    res = readUint8FromCmd(maxCount);
     if (res != OK) return res;
     uint8_t minWaitDelaySec = 0;
-    res = readUint8FromCmdBuff(minWaitDelaySec);
+    res = readUint8FromCmd(minWaitDelaySec);
     if (res != OK) return res;
     uint16_t contactReadyWaitDelayMillis = 0;
-    res = readUint16FromCmdBuff(contactReadyWaitDelayMillis);
+    res = readUint16FromCmd(contactReadyWaitDelayMillis);
     if (res != OK) return res;
     settings.saveStateFixSettings(StateFixSettings(delayMillis, maxCount, minWaitDelaySec, contactReadyWaitDelayMillis));
     return OK;
 }
 
+ErrorCode Server::sendFixData() {
+    sendStartResponse(IDC_FIX_DATA);
+    uint8_t count = settings.getRelaysCount();
+    sendSerial(count);
+    for (uint8_t i = 0; i < count; i++) {
+        sendSerial(RelayController::getFixTryCount(i));
+        sendSerial(RelayController::getFixLastTryTime(i));
+    }
+    return OK;
+}
+
+ErrorCode Server::sendTxQueueStatistics() {
+    sendStartResponse(IDC_TX_QUEUE_STATISTICS);
+    sendSerial(TxQueue::getSignalDepth());
+    sendSerial(TxQueue::getMaxSignalDepth());
+    sendSerial(TxQueue::getResponseDepth());
+    sendSerial(TxQueue::getMaxResponseDepth());
+    sendSerial(TxQueue::getDroppedSignalsCount());
+    sendSerial(TxQueue::getResponseOverflowCount());
+    return OK;
+}
+
+ErrorCode Server::sendSchedulerStatistics() {
+    sendStartResponse(IDC_SCHEDULER_STATISTICS);
+    sendSerial((uint8_t) ST_COUNT);
+    for (uint8_t i = 0; i < ST_COUNT; i++) {
+        sendSerial(Scheduler::getRunCount((SchedulerTask) i));
+        sendSerial(Scheduler::getMaxRunMicros((SchedulerTask) i));
+    }
+    sendSerial(Scheduler::getSleepCount());
+    return OK;
+}
+
 ErrorCode Server::sendRemoteTimestamp() {
     sendStartResponse(IDC_REMOTE_TIMESTAMP);
     sendSerial(RelayController::getRemoteTimeStamp());
@@ -413,7 +964,7 @@ ErrorCode Server::sendRemoteTimestamp() {
 
 ErrorCode Server::saveRemoteTimestamp() {
     uint32_t value = 0;
-    ErrorCode res = readUint32FromCommandBuffer(value);
+    ErrorCode res = readUint32FromCmd(value);
     if (res != OK) return res;
     RelayController::setRemoteTimeStamp(value);
     return OK;
@@ -421,46 +972,71 @@ ErrorCode Server::saveRemoteTimestamp() {
 
 #ifdef MEM_32KB
 
-ErrorCode Server::sendInterruptPin(bool addResultCode) {
-    if (addResultCode) {
-        sendStartResponse(IDC_INTERRUPT_PIN);
-    }
-    sendSerial(settings.getControlInterruptPin());
-    return OK;
-}
-
-ErrorCode Server::saveInterruptPin() {
-    uint8_t pin = 0;
-    ErrorCode res = readUint8FromCmdBuff(pin);
-    if (res != OK) return res;
-    return settings.saveControlInterruptPin(pin) ? OK : E_CONTROL_INTERRUPTED_PIN_NOT_ALLOWED_VALUE;
-}
-
 ErrorCode Server::sendSwitchCountingSettings() {
+    uint8_t relayIdx = 0;
+    ErrorCode res = readRelayIndexFromCmd(relayIdx);
+    if (res != OK) return res;
+    const SwitchCountingSettings &switchCountingSettings = settings.getSwitchCountingSettingsRef(relayIdx);
     sendStartResponse(IDC_SWITCH_COUNTING_SETTINGS);
-    sendSerial(settings.getSwitchCountingSettingsRef().getSwitchLimitIntervalSec());
-    sendSerial(settings.getSwitchCountingSettingsRef().getMaxSwitchCount());
+    sendSerial(relayIdx);
+    sendSerial(switchCountingSettings.getSwitchLimitIntervalSec());
+    sendSerial(switchCountingSettings.getMaxSwitchCount());
     return OK;
 }
 
 ErrorCode Server::saveSwitchCountingSettings() {
     uint8_t relayIdx = 0;
-    ErrorCode res = readRelayIndexFromCmdBuff(relayIdx);
+    ErrorCode res = readRelayIndexFromCmd(relayIdx);
     if (res != OK) return res;
     uint16_t switchLimitIntervalSec = 0;
-    res = readUint16FromCmdBuff(switchLimitIntervalSec);
+    res = readUint16FromCmd(switchLimitIntervalSec);
     if (res != OK) return res;
     uint8_t switchMaxCount = 0;
-    res = readUint8FromCmdBuff(switchMaxCount);
+    res = readUint8FromCmd(switchMaxCount);
     if (res != OK) return res;
     if (switchMaxCount > MAX_SWITCH_LIMIT_COUNT) return E_SWITCH_COUNT_MAX_VALUE_OVERFLOW;
-    settings.saveSwitchCountingSettings(SwitchCountingSettings(switchLimitIntervalSec, switchMaxCount));
+    settings.saveSwitchCountingSettings(relayIdx, SwitchCountingSettings(switchLimitIntervalSec, switchMaxCount));
+    return OK;
+}
+
+ErrorCode Server::sendScene() {
+    uint8_t sceneIdx = 0;
+    ErrorCode res = readSceneIndexFromCmd(sceneIdx);
+    if (res != OK) return res;
+    const RelayScene &scene = settings.getSceneRef(sceneIdx);
+    sendStartResponse(IDC_SCENE);
+    sendSerial(sceneIdx);
+    sendSerial(scene.getMask());
+    sendSerial(scene.getSwitchedOn());
+    return OK;
+}
+
+ErrorCode Server::saveScene() {
+    uint8_t sceneIdx = 0;
+    ErrorCode res = readSceneIndexFromCmd(sceneIdx);
+    if (res != OK) return res;
+    uint16_t mask = 0;
+    res = readUint16FromCmd(mask);
+    if (res != OK) return res;
+    uint16_t switchedOn = 0;
+    res = readUint16FromCmd(switchedOn);
+    if (res != OK) return res;
+    settings.saveScene(sceneIdx, RelayScene(mask, switchedOn));
+    return OK;
+}
+
+ErrorCode Server::applyScene() {
+    uint8_t sceneIdx = 0;
+    ErrorCode res = readSceneIndexFromCmd(sceneIdx);
+    if (res != OK) return res;
+    const RelayScene &scene = settings.getSceneRef(sceneIdx);
+    RelayController::setRelayStates(scene.getMask(), scene.getSwitchedOn());
     return OK;
 }
 
 ErrorCode Server::clearSwitchCount() {
     uint8_t relayIdx = 0;
-    ErrorCode res = readRelayIndexFromCmdBuff(relayIdx);
+    ErrorCode res = readRelayIndexFromCmd(relayIdx);
     if (res != OK) return res;
     RelayController::clearSwitchCount(relayIdx);
     return OK;
@@ -469,7 +1045,8 @@ ErrorCode Server::clearSwitchCount() {
 ErrorCode Server::sendAll() {
     sendStartResponse(IDC_ALL);
     sendId(false);
-    sendInterruptPin(false);
+    //the byte of the deprecated control interrupt pin keeps the layout
+    sendSerial(0);
     sendSerial(settings.getRelaysCount());
     sendSettings(false);
     sendState(false);
@@ -478,16 +1055,27 @@ ErrorCode Server::sendAll() {
 
 ErrorCode Server::saveAll() {
     uint8_t relayCount = 0;
-    ErrorCode res = readRelayCountFromCmdBuff(relayCount);
+    ErrorCode res = readRelayCountFromCmd(relayCount);
+    if (res != OK) return res;
+    //everything is checked before applying, so a broken command does not leave settings half saved
+    uint32_t controllerId = 0;
+    res = readUint32FromCmd(controllerId);
+    if (res != OK) return res;
+    //the byte of the deprecated control interrupt pin is ignored
+    uint8_t unused = 0;
+    res = readUint8FromCmd(unused);
+    if (res != OK) return res;
+    uint8_t settingsRes = readRelaySettingsFromCmd(relayCount);
+    if (settingsRes != OK) return (ErrorCode) settingsRes;
+    uint16_t mask = 0;
+    uint16_t switchedOn = 0;
+    uint16_t disabled = 0;
+    res = readRelayStatesFromCmd(relayCount, mask, switchedOn, disabled);
     if (res != OK) return res;
-    if (cmdBuffCurrPos + sizeof(uint32_t) + relayCount * SETTINGS_SIZE_PER_RELAY + SET_RELAY_STATE_DATA_SIZE * relayCount + 1 > cmdBuffSize) {
-        return E_REQUEST_DATA_NO_VALUE;
-    }
 
-    saveId();
-    saveInterruptPin();
-    saveSettings();
-    saveState();
+    settings.saveControllerId(controllerId);
+    settings.saveRelaySettings(cmdRelaySettings, relayCount);
+    applyRelayStates(mask, switchedOn, disabled);
 
     return OK;
 }
@@ -540,7 +1128,7 @@ ErrorCode Server::sendRelayControlOn() {
 
 ErrorCode Server::send(uint8_t(*getter)(Server*, uint8_t), InstructionDataCode dataCode) {
     uint8_t relayIndex;
-    ErrorCode res = readRelayIndexFromCmdBuff(relayIndex);
+    ErrorCode res = readRelayIndexFromCmd(relayIndex);
     if (res != OK) return res;
     uint8_t value = getter(this, relayIndex);
     sendStartResponse(dataCode);
@@ -555,7 +1143,7 @@ ErrorCode Server::send(uint8_t(*getter)(Server*, uint8_t), InstructionDataCode d
 
 ErrorCode Server::save(void(*setter)(Server*, uint8_t, uint8_t)) {
     uint8_t cmdData = 0;
-    ErrorCode res = readUint8FromCmdBuff(cmdData);
+    ErrorCode res = readUint8FromCmd(cmdData);
     if (res != OK) return res;
     uint8_t relayIndex = cmdData & 0x0f;
     if (relayIndex >= settings.getRelaysCount()) return E_RELAY_INDEX_OUT_OF_RANGE;
@@ -578,17 +1166,73 @@ ErrorCode Server::saveRelayState() {
 }
 
 ErrorCode Server::sendSwitchData() {
+    //entries not fitting the TX room stay for the next read
+    uint8_t dataCount = SwitchHistory::countFittingEntries(
+            TxQueue::getResponseRoom() - (TX_RESPONSE_HEADER_SIZE + sizeof (uint8_t) + sizeof (uint16_t)));
     sendStartResponse(IDC_SWITCH_DATA);
-    uint32_t *switchData;
-    uint8_t dataCount = RelayController::getSwitchData(&switchData);
     sendSerial(dataCount);
     for (uint8_t i = 0; i < dataCount; i++) {
-        sendSerial(switchData[i].state);//u8
-        sendSerial(switchData[i].time);//u32
+        uint8_t size = SwitchHistory::getEntrySize();
+        for (uint8_t j = 0; j < size; j++) {
+            sendSerial(SwitchHistory::getEntryByte(j));
+        }
+        SwitchHistory::dropEntry(size);
+    }
+    sendSerial(SwitchHistory::getOverflowCount());
+    return OK;
+}
+
+//records not fitting the TX room are left out, the host reads on after the last received seq
+ErrorCode Server::sendJournal() {
+    uint16_t fromSeq = 0;
+    ErrorCode res = readUint16FromCmd(fromSeq);
+    if (res != OK) return res;
+    uint8_t count = 0;
+    res = readUint8FromCmd(count);
+    if (res != OK) return res;
+    uint16_t nextSeq = EventJournal::getNextSeq();
+    uint16_t available = nextSeq - fromSeq;
+    if (available > JOURNAL_RECORDS_COUNT) {
+        //older records are overwritten already
+        fromSeq = nextSeq - JOURNAL_RECORDS_COUNT;
+        available = JOURNAL_RECORDS_COUNT;
+    }
+    if (count > available) count = available;
+    if (count > JOURNAL_MAX_READ_COUNT) count = JOURNAL_MAX_READ_COUNT;
+    uint8_t fittingCount = (TxQueue::getResponseRoom() - (TX_RESPONSE_HEADER_SIZE + 2 * sizeof (uint16_t) + sizeof (uint8_t)))
+            / JOURNAL_SENT_RECORD_SIZE;
+    if (count > fittingCount) count = fittingCount;
+    JournalRecord record;
+    uint8_t validCount = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (EventJournal::readRecord(fromSeq + i, record)) {
+            validCount++;
+        }
+    }
+    sendStartResponse(IDC_JOURNAL);
+    sendSerial(nextSeq);
+    sendSerial(EventJournal::getDroppedCount());
+    sendSerial(validCount);
+    //torn records are skipped, so reading EEPROM twice is cheaper than buffering them in RAM
+    for (uint8_t i = 0; i < count; i++) {
+        if (EventJournal::readRecord(fromSeq + i, record)) {
+            sendSerial(record.seq);
+            sendSerial(record.state);
+            sendSerial(record.time);
+        }
     }
     return OK;
 }
 
+ErrorCode Server::saveSwitchDataPolicy() {
+    uint8_t policy = 0;
+    ErrorCode res = readUint8FromCmd(policy);
+    if (res != OK) return res;
+    if (policy != RBP_DROP_NEWEST && policy != RBP_OVERWRITE_OLDEST) return E_UNDEFINED_OPERATION;
+    SwitchHistory::setPolicy((RingBufferPolicy) policy);
+    return OK;
+}
+
 ErrorCode Server::sendContactWaitData() {
     sendStartResponse(IDC_CONTACT_WAIT_DATA);
     uint8_t dataCount = settings.getRelaysCount();
@@ -601,20 +1245,9 @@ ErrorCode Server::sendContactWaitData() {
 
 #else
 
-ErrorCode Server::sendFixData() {
-    sendStartResponse(IDC_FIX_DATA);
-    uint8_t count = settings.getRelaysCount();
-    sendSerial(count);
-    for (uint8_t i = 0; i < count; i++) {
-        sendSerial(RelayController::getFixTryCount(i));
-        sendSerial(RelayController::getFixLastTryTime(i));
-    }
-    return OK;
-}
-
 ErrorCode Server::sendRelayState() {
     uint8_t relayIndex;
-    ErrorCode res = readUint8FromCmdBuff(relayIndex);
+    ErrorCode res = readUint8FromCmd(relayIndex);
     if (res != OK) return res;
     if (res >= settings.getRelaysCount()) return E_RELAY_INDEX_OUT_OF_RANGE;
     uint8_t value = Server::readRelayStateBits(relayIndex);
@@ -625,7 +1258,7 @@ ErrorCode Server::sendRelayState() {
 
 ErrorCode Server::saveRelayState() {
     uint8_t cmdData = 0;
-    ErrorCode res = readUint8FromCmdBuff(cmdData);
+    ErrorCode res = readUint8FromCmd(cmdData);
     if (res != OK) return res;
     uint8_t relayIndex = cmdData & 0x0f;
     if (relayIndex >= settings.getRelaysCount()) return E_RELAY_INDEX_OUT_OF_RANGE;
@@ -636,42 +1269,110 @@ ErrorCode Server::saveRelayState() {
 
 #endif
 
-ErrorCode Server::readUint8FromCmdBuff(uint8_t &result) {
-    if (cmdBuffSize < cmdBuffCurrPos + 1) return E_REQUEST_DATA_NO_VALUE;
-    result = cmdBuff[cmdBuffCurrPos++];
+//the decoded fields are taken in command order, their sizes are given by commandFields()
+ErrorCode Server::readUint32FromCmd(uint32_t &result) {
+    if (cmdValuesPos == cmdValuesCount) return E_REQUEST_DATA_NO_VALUE;
+    result = cmdValues[cmdValuesPos++];
     return OK;
 }
 
-ErrorCode Server::readUint16FromCmdBuff(uint16_t &result) {
-    if (cmdBuffSize < cmdBuffCurrPos + sizeof(uint16_t)) return E_REQUEST_DATA_NO_VALUE;
-    result |= ((uint_fast16_t)cmdBuff[cmdBuffCurrPos++]) << 8;
-    result |= cmdBuff[cmdBuffCurrPos++];
+ErrorCode Server::readUint8FromCmd(uint8_t &result) {
+    uint32_t value = 0;
+    ErrorCode res = readUint32FromCmd(value);
+    if (res != OK) return res;
+    result = (uint8_t) value;
     return OK;
 }
 
-ErrorCode Server::readUint32FromCommandBuffer(uint32_t &result) {
-    if (cmdBuffSize < cmdBuffCurrPos + sizeof(uint32_t)) return E_REQUEST_DATA_NO_VALUE;
-    result |= ((uint_fast32_t)cmdBuff[cmdBuffCurrPos++]) << 24;
-    result |= ((uint_fast32_t)cmdBuff[cmdBuffCurrPos++]) << 16;
-    result |= ((uint_fast32_t)cmdBuff[cmdBuffCurrPos++]) << 8;
-    result |= cmdBuff[cmdBuffCurrPos++];
+ErrorCode Server::readUint16FromCmd(uint16_t &result) {
+    uint32_t value = 0;
+    ErrorCode res = readUint32FromCmd(value);
+    if (res != OK) return res;
+    result = (uint16_t) value;
     return OK;
 }
 
 #ifdef MEM_32KB
-ErrorCode Server::readRelayIndexFromCmdBuff(uint8_t &result) {
+ErrorCode Server::readRelayIndexFromCmd(uint8_t &result) {
     uint8_t res = 0;
-    ErrorCode readRes = readUint8FromCmdBuff(res);
+    ErrorCode readRes = readUint8FromCmd(res);
     if (readRes != OK) return readRes;
     if (res >= settings.getRelaysCount()) return E_RELAY_INDEX_OUT_OF_RANGE;
     result = res;
     return OK;
 }
+
+// histogram of the phase is reset once sent, so every fetch covers the time since the previous one
+ErrorCode Server::sendLatencyHistogram() {
+    uint8_t phase = 0;
+    ErrorCode res = readUint8FromCmd(phase);
+    if (res != OK) return res;
+    if (phase >= LP_COUNT) return E_PHASE_INDEX_OUT_OF_RANGE;
+    sendStartResponse(IDC_LATENCY_HISTOGRAM);
+    sendSerial(phase);
+    sendSerial((uint8_t) LATENCY_BUCKETS_COUNT);
+    for (uint8_t i = 0; i < LATENCY_BUCKETS_COUNT; i++) {
+        sendSerial(LatencyHistograms::getCount((LoopPhase) phase, i));
+    }
+    sendSerial((uint8_t) LATENCY_TICKS_PER_MICROSECOND);
+    sendSerial(LatencyHistograms::getMaxTicks((LoopPhase) phase));
+    LatencyHistograms::clear((LoopPhase) phase);
+    return OK;
+}
+
+// with signals on, every executed command is followed by IDC_COMMAND_CYCLES signal with its codes and ticks
+ErrorCode Server::saveCommandCyclesSignals() {
+    uint8_t enabled = 0;
+    ErrorCode res = readUint8FromCmd(enabled);
+    if (res != OK) return res;
+    commandCyclesSignals = enabled != 0;
+    return OK;
+}
+
+ErrorCode Server::sendTelemetrySubscription() {
+    sendStartResponse(IDC_TELEMETRY);
+    sendSerial(Telemetry::isEnabled());
+    sendSerial(Telemetry::getIntervalMillis());
+    sendSerial(Telemetry::getSeq());
+    return OK;
+}
+
+// merged counts are cleared once sent, so every response holds the events merged since the previous one
+ErrorCode Server::sendMergedEvents() {
+    uint8_t count = settings.getRelaysCount();
+    sendStartResponse(IDC_MERGED_EVENTS);
+    sendSerial(count);
+    for (uint8_t i = 0; i < count; i++) {
+        sendSerial(EventSignals::getMergedCount(i));
+    }
+    EventSignals::clearMergedCounts();
+    return OK;
+}
+
+ErrorCode Server::saveTelemetrySubscription() {
+    uint8_t enabled = 0;
+    ErrorCode res = readUint8FromCmd(enabled);
+    if (res != OK) return res;
+    uint16_t intervalMillis = 0;
+    res = readUint16FromCmd(intervalMillis);
+    if (res != OK) return res;
+    Telemetry::subscribe(enabled != 0, intervalMillis);
+    return OK;
+}
+
+ErrorCode Server::readSceneIndexFromCmd(uint8_t &result) {
+    uint8_t res = 0;
+    ErrorCode readRes = readUint8FromCmd(res);
+    if (readRes != OK) return readRes;
+    if (res >= MAX_SCENES_COUNT) return E_SCENE_INDEX_OUT_OF_RANGE;
+    result = res;
+    return OK;
+}
 #endif
 
-ErrorCode Server::readRelayCountFromCmdBuff(uint8_t &count) {
+ErrorCode Server::readRelayCountFromCmd(uint8_t &count) {
     uint8_t res = 0;
-    ErrorCode readRes = readUint8FromCmdBuff(res);
+    ErrorCode readRes = readUint8FromCmd(res);
     if (readRes != OK) return readRes;
     if (res >= MAX_RELAYS_COUNT) return E_RELAY_COUNT_OVERFLOW;
     count = res;
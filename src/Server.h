@@ -10,46 +10,137 @@
 #include "RelayController.h"
 #include "CommunicationProtocol.h"
 
-#define CMD_BUFF_SIZE 30
+#define MAX_COMMANDS_PER_ROUND 4
+//scalar fields of a command, state fix settings have the most
+#define MAX_COMMAND_VALUES 4
+#ifdef MEM_32KB
+//main code, data code, request id
+#define CMD_HEADER_SIZE 6
+//batch items are kept until the CRC of the batch matched
+#define BATCH_BUFF_SIZE 128
+#else
+//main code, data code
+#define CMD_HEADER_SIZE 2
+#endif
+
+enum FrameReadState : uint8_t {
+    FRS_START,
+    FRS_LENGTH,
+    FRS_PAYLOAD,
+    FRS_CRC
+};
+
+/*
+ * Fields of a command after its header, packed by CF_BITS from the first one. The command is decoded as its bytes
+ * arrive, the handlers take the decoded fields once the CRC matched.
+ */
+enum CommandField : uint8_t {
+    CF_END,
+    CF_U8,
+    CF_U16,
+    CF_U32,
+    //relay count and 3 settings bytes per relay
+    CF_RELAY_SETTINGS,
+    //relay count and 2 state bits per relay, 4 relays in a byte
+    CF_RELAY_STATES,
+    //rest of the payload, kept for the batch items
+    CF_BATCH_ITEMS
+};
+#define CF_BITS 3
+#define CF_BITS_MASK 0x07
 
 
 class Server {
 public:
-    Server(Settings &settings) : settings(settings) {
-        for (unsigned char & i : cmdBuff) {
-            i = 0;
-        }
-    }
+    Server(Settings &settings) : settings(settings) {}
     void setup();
-    void idle();
+    bool receive();
 private:
     Settings &settings;
-    uint8_t cmdBuff[CMD_BUFF_SIZE];
-    uint8_t cmdBuffSize = 0;
-    uint8_t cmdBuffCurrPos = 0;
+    InstructionCode cmdMainCode = IC_NONE;
+    InstructionDataCode cmdDataCode = IDC_NONE;
+    bool cmdFramed = false;
+    uint8_t cmdHeaderPos = 0;
+    uint16_t cmdFields = CF_END;
+    uint8_t cmdFieldPos = 0;
+    uint32_t cmdFieldValue = 0;
+    //bytes after the header
+    uint8_t cmdArgsSize = 0;
+    uint32_t cmdValues[MAX_COMMAND_VALUES];
+    uint8_t cmdValuesCount = 0;
+    uint8_t cmdValuesPos = 0;
+    RelaySettings cmdRelaySettings[MAX_RELAYS_COUNT];
+    uint8_t cmdRelaySettingsCount = 0;
+    uint8_t cmdRelaySettingsSize = 0;
+    uint8_t cmdRelayStatesCount = 0;
+    uint8_t cmdRelayStatesSize = 0;
+    uint16_t cmdRelayStatesMask = 0;
+    uint16_t cmdRelaysSwitchedOn = 0;
+    uint16_t cmdRelaysDisabled = 0;
+#ifdef MEM_32KB
+    uint32_t cmdId = 0;
+    uint8_t batchBuff[BATCH_BUFF_SIZE];
+    uint8_t batchSize = 0;
+    uint8_t batchPos = 0;
+    bool batchOverflow = false;
+    bool commandCyclesSignals = false;
+    //batch, which items are executed over several rounds
+    bool batchPending = false;
+    bool batchAtomic = false;
+    uint8_t batchItemsLeft = 0;
+    ErrorCode batchResult = OK;
+    SettingsData batchSnapshot;
+#endif
     bool commandParsed = false;
     bool commandPocessed = false;
     uint32_t lastPacketTime = 0;
     uint8_t lastPacketSize = 0;
+    FrameReadState frameReadState = FRS_START;
+    bool frameResync = false;
+    uint8_t frameLength = 0;
+    uint8_t framePos = 0;
+    uint8_t frameCrc = 0;
+    uint32_t lastFrameByteTime = 0;
     static uint16_t minCycleDuration;
     static uint16_t maxCycleDuration;
     static uint64_t cyclesCount;
-    static uint64_t lastCycleTime;
+    static uint32_t lastCycleTime;
 
     static void updateStatistics();
     bool readBinaryCommand();
+    bool readFramedCommand();
+    void resetFrame(bool resync);
+    void startDecode();
+    void decodeCmdByte(uint8_t value);
+    void startFields(uint16_t fields);
+    void decodeField(uint8_t value);
+    void nextField();
+    void startCommand(bool framed);
+    bool acceptCommand();
+    void finishCmdRead();
+    void finishCommand();
     void processBinaryInstruction();
+    ErrorCode executeInstruction(InstructionCode mainCode, InstructionDataCode dataCode);
     ErrorCode processBinaryRead(InstructionDataCode dataCode);
     ErrorCode processBinarySet(InstructionDataCode dataCode);
+#ifdef MEM_32KB
+    ErrorCode processBinaryCommand(InstructionDataCode dataCode);
+    ErrorCode processBatch();
+    bool continueBatch();
+    ErrorCode processBatchItem(bool atomic, bool skip);
+    ErrorCode readBatchByte(uint8_t &result);
+    static bool isSettingsInstruction(InstructionCode mainCode, InstructionDataCode dataCode);
+#endif
     void sendSettings(bool addResultCode = true);
     uint8_t saveSettings();
+    uint8_t readRelaySettingsFromCmd(uint8_t &relayCount);
     ErrorCode sendState(bool addResultCode = true);
     ErrorCode saveState();
+    ErrorCode readRelayStatesFromCmd(uint8_t relayCount, uint16_t &mask, uint16_t &switchedOn, uint16_t &disabled);
+    static void applyRelayStates(uint16_t mask, uint16_t switchedOn, uint16_t disabled);
     ErrorCode sendId(bool addResultCode = true);
     ErrorCode saveId();
 #ifdef MEM_32KB
-    ErrorCode sendInterruptPin(bool addResultCode = true);
-    ErrorCode saveInterruptPin();
     ErrorCode sendAll();
     ErrorCode saveAll();
 #endif
@@ -67,22 +158,35 @@ private:
     ErrorCode sendSwitchCountingSettings();
     ErrorCode saveSwitchCountingSettings();
     ErrorCode clearSwitchCount();
+    ErrorCode sendScene();
+    ErrorCode saveScene();
+    ErrorCode applyScene();
 #endif
     ErrorCode sendStateFixSettings();
     ErrorCode saveStateFixSettings();
     static ErrorCode sendRemoteTimestamp();
+    static ErrorCode sendTxQueueStatistics();
+    static ErrorCode sendSchedulerStatistics();
     ErrorCode saveRemoteTimestamp();
     ErrorCode sendFixData();
 #ifdef MEM_32KB
     ErrorCode sendContactWaitData();
     static ErrorCode sendSwitchData();
-    ErrorCode readRelayIndexFromCmdBuff(uint8_t &result);
+    ErrorCode saveSwitchDataPolicy();
+    ErrorCode sendJournal();
+    ErrorCode sendLatencyHistogram();
+    ErrorCode saveCommandCyclesSignals();
+    static ErrorCode sendTelemetrySubscription();
+    ErrorCode saveTelemetrySubscription();
+    ErrorCode sendMergedEvents();
+    ErrorCode readRelayIndexFromCmd(uint8_t &result);
+    ErrorCode readSceneIndexFromCmd(uint8_t &result);
 #endif
-    ErrorCode readUint8FromCmdBuff(uint8_t &result);
-    ErrorCode readUint32FromCommandBuffer(uint32_t &result);
-    ErrorCode readRelayCountFromCmdBuff(uint8_t &count);
+    ErrorCode readUint8FromCmd(uint8_t &result);
+    ErrorCode readUint32FromCmd(uint32_t &result);
+    ErrorCode readRelayCountFromCmd(uint8_t &count);
     static uint8_t readRelayStateBits(uint8_t relayIndex);
-    ErrorCode readUint16FromCmdBuff(uint16_t &result);
+    ErrorCode readUint16FromCmd(uint16_t &result);
 };
 
 
@@ -4,82 +4,226 @@
 
 #include "Settings.h"
 #include <EEPROM.h>
+#include <util/crc16.h>
+#include "Clock.h"
+#include "Hal.h"
+#ifdef STATIC_RELAYS
+#include "StaticRelaysConfig.h"
+#endif
 
 
 void Settings::load() {
-    relaysCount = EEPROM.read(RELAYS_COUNT_LOCATION);
-    if (relaysCount > MAX_RELAYS_COUNT) {
-        relaysCount = DEFAULT_RELAYS_COUNT;
-        EEPROM.update(RELAYS_COUNT_LOCATION, relaysCount);
+    if (!loadImage()) {
+        //the layout used before images and defaults are written as an image with the next commit
+        if (!loadLegacy()) {
+            data = SettingsData();
+        }
+        markChanged();
+    }
+    validate();
+    ready = true;
+}
+
+inline uint16_t getSlotLocation(uint8_t slot) {
+    return SETTINGS_SLOTS_LOCATION + slot * SETTINGS_SLOT_SIZE;
+}
+
+inline uint16_t updateImageCrc(uint16_t crc, const void *buff, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        crc = _crc16_update(crc, ((const uint8_t *) buff)[i]);
+    }
+    return crc;
+}
+
+// finds the newest image of this version and size with valid CRC in the slots and reads its data to buff
+bool readNewestImage(void *buff, uint8_t size, uint8_t &slot, uint16_t &seq) {
+    uint8_t failedSlots = 0;
+    while (true) {
+        //headers are enough to find the newest image, only it is read as a whole
+        bool found = false;
+        SettingsImageHeader header;
+        SettingsImageHeader newest;
+        for (uint8_t i = 0; i < SETTINGS_SLOTS_COUNT; i++) {
+            if (CHECK_BIT(failedSlots, i)) continue;
+            EEPROM.get(getSlotLocation(i), header);
+            if (header.magic == SETTINGS_IMAGE_MAGIC && header.version == SETTINGS_IMAGE_VERSION && header.size == size
+                    && (!found || (int16_t) (header.seq - newest.seq) > 0)) {
+                found = true;
+                newest = header;
+                slot = i;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        uint16_t location = getSlotLocation(slot) + sizeof (SettingsImageHeader);
+        for (uint8_t i = 0; i < size; i++) {
+            ((uint8_t *) buff)[i] = EEPROM.read(location + i);
+        }
+        uint16_t storedCrc;
+        EEPROM.get(location + size, storedCrc);
+        uint16_t crc = updateImageCrc(updateImageCrc(0xffff, &newest, sizeof (SettingsImageHeader)), buff, size);
+        if (crc == storedCrc) {
+            seq = newest.seq;
+            return true;
+        }
+        failedSlots |= 1 << slot;
+    }
+}
+
+bool Settings::loadImage() {
+    return readNewestImage(&data, sizeof (SettingsData), activeSlot, activeSeq);
+}
+
+bool Settings::loadLegacy() {
+    data = SettingsData();
+    data.relaysCount = EEPROM.read(RELAYS_COUNT_LOCATION);
+    if (data.relaysCount > MAX_RELAYS_COUNT) {
+        //erased EEPROM
+        return false;
     }
-    EEPROM.get(CONTROLLER_ID_LOCATION, controllerId);
-    EEPROM.get(STATE_FIX_SETTINGS_LOCATION, stateFixSettings);
+    EEPROM.get(CONTROLLER_ID_LOCATION, data.controllerId);
+    EEPROM.get(STATE_FIX_SETTINGS_LOCATION, data.stateFixSettings);
+    const StateFixSettings &stateFixSettings = data.stateFixSettings;
     if (
             stateFixSettings.getContactReadyWaitDelayMillis() == 0xffff &&
             stateFixSettings.getMinWaitDelaySec() == 0xff &&
             stateFixSettings.getMaxCount() == 0xff &&
             stateFixSettings.getDelayMillis() == 0xffff
             ) {
-        saveStateFixSettings(StateFixSettings());
+        data.stateFixSettings = StateFixSettings();
     }
 #ifdef MEM_32KB
-    EEPROM.get(CONTROL_INTERRUPT_PIN_LOCATION, controlInterruptPin);
+    SwitchCountingSettings switchCountingSettings;
     EEPROM.get(STATE_SWITCH_COUNT_SETTINGS_LOCATION, switchCountingSettings);
+    for (auto &relaySwitchCountingSettings : data.switchCountingSettings) {
+        relaySwitchCountingSettings = switchCountingSettings;
+    }
+    //the legacy firmware had no scenes, they stay empty
 #endif
-    for (uint8_t i = 0; i < relaysCount; i++) {
-        EEPROM.get(RELAYS_SETTINGS_START_LOCATION + i * sizeof (RelaySettings), relaySettings[i]);
+    for (uint8_t i = 0; i < data.relaysCount; i++) {
+        EEPROM.get(RELAYS_SETTINGS_START_LOCATION + i * sizeof (RelaySettings), data.relaySettings[i]);
     }
-    ready = true;
+    return true;
 }
 
-uint8_t Settings::saveRelaySettings(RelaySettings settings[], uint8_t count) {
+// whatever was loaded, pins not usable for relays are never driven
+void Settings::validate() {
+#ifdef STATIC_RELAYS
+    data.relaysCount = STATIC_RELAYS_COUNT;
+    for (uint8_t i = 0; i < STATIC_RELAYS_COUNT; i++) {
+        data.relaySettings[i] = RelaySettings(STATIC_RELAYS_TABLE[i][0], STATIC_RELAYS_TABLE[i][1], STATIC_RELAYS_TABLE[i][2]);
+    }
+#endif
+    if (data.relaysCount > MAX_RELAYS_COUNT) {
+        data.relaysCount = DEFAULT_RELAYS_COUNT;
+    }
+    for (auto &relaySettings : data.relaySettings) {
+        relaySettings = relaySettings.sanitized();
+    }
+}
+
+void Settings::markChanged() {
+    dirty = true;
+    //commit in progress is restarted, so a slot never gets a mix of old and new data
+    committing = false;
+    lastChangeMillis = Clock::getMillis();
+}
+
+void Settings::startCommit() {
+    commitHeader.magic = SETTINGS_IMAGE_MAGIC;
+    commitHeader.version = SETTINGS_IMAGE_VERSION;
+    commitHeader.size = sizeof (SettingsData);
+    commitHeader.seq = activeSeq + 1;
+    commitCrc = updateImageCrc(updateImageCrc(0xffff, &commitHeader, sizeof (SettingsImageHeader)),
+                               &data, sizeof (SettingsData));
+    commitPos = 0;
+    committing = true;
+    commitRequested = false;
+    dirty = false;
+}
+
+uint8_t Settings::getCommitByte(uint8_t pos) const {
+    if (pos < sizeof (SettingsImageHeader)) {
+        return ((const uint8_t *) &commitHeader)[pos];
+    }
+    pos -= sizeof (SettingsImageHeader);
+    if (pos < sizeof (SettingsData)) {
+        return ((const uint8_t *) &data)[pos];
+    }
+    pos -= sizeof (SettingsData);
+    return ((const uint8_t *) &commitCrc)[pos];
+}
+
+bool Settings::idle() {
+    if (!committing) {
+        if (!dirty || (!commitRequested && Clock::getMillis() - lastChangeMillis < SETTINGS_COMMIT_DELAY_MILLIS)) return false;
+        startCommit();
+    }
+    if (!halIsEepromReady()) return false;
+    uint16_t location = getSlotLocation((activeSlot + 1) % SETTINGS_SLOTS_COUNT);
+    //unchanged bytes are skipped right away, at most one byte is written per call
+    while (commitPos < SETTINGS_SLOT_SIZE) {
+        uint8_t value = getCommitByte(commitPos);
+        uint16_t address = location + commitPos;
+        commitPos++;
+        if (EEPROM.read(address) != value) {
+            EEPROM.write(address, value);
+            return true;
+        }
+    }
+    activeSlot = (activeSlot + 1) % SETTINGS_SLOTS_COUNT;
+    activeSeq++;
+    committing = false;
+    return true;
+}
+
+uint8_t Settings::saveRelaySettings([[maybe_unused]] RelaySettings settings[], [[maybe_unused]] uint8_t count) {
+#ifdef STATIC_RELAYS
+    //wiring is fixed at compile time
+    return data.relaysCount;
+#else
     if (count > MAX_RELAYS_COUNT) {
         count = MAX_RELAYS_COUNT;
     }
-    relaysCount = count;
-    EEPROM.update(RELAYS_COUNT_LOCATION, relaysCount);
+    change(data.relaysCount, count);
+    //pins not usable for relays are never driven, like on load
     for (uint8_t i = 0; i < count; i++) {
-        relaySettings[i] = settings[i];
-        EEPROM.put(RELAYS_SETTINGS_START_LOCATION + i * sizeof (RelaySettings), relaySettings[i]);
+        change(data.relaySettings[i], settings[i].sanitized());
     }
     if (onSettingsChanged != nullptr) {
         onSettingsChanged();
     }
     return count;
+#endif
 }
 
 void Settings::saveControllerId(uint32_t value) {
-    controllerId = value;
-    EEPROM.put(CONTROLLER_ID_LOCATION, value);
+    change(data.controllerId, value);
 }
 
 void Settings::saveStateFixSettings(const StateFixSettings &value) {
-    stateFixSettings = value;
-    EEPROM.put(STATE_FIX_SETTINGS_LOCATION, stateFixSettings);
+    change(data.stateFixSettings, value);
 }
 
 
 #ifdef MEM_32KB
 
-const uint8_t ALLOWED_INTERRUPT_PINS[] = {2, 3};
+void Settings::saveSwitchCountingSettings(uint8_t relayIdx, const SwitchCountingSettings &value) {
+    change(data.switchCountingSettings[relayIdx], value);
+}
 
-bool Settings::saveControlInterruptPin(uint8_t value) {
-    bool allowed = false;
-    for (unsigned char i : ALLOWED_INTERRUPT_PINS) {
-        if (i == value) {
-            allowed = true;
-            break;
-        }
-    }
-    if (!allowed) return false;
-    controlInterruptPin = value;
-    EEPROM.put(CONTROL_INTERRUPT_PIN_LOCATION, value);
-    return true;
+void Settings::saveScene(uint8_t sceneIdx, const RelayScene &scene) {
+    change(data.scenes[sceneIdx], scene);
 }
 
-void Settings::saveSwitchCountingSettings(const SwitchCountingSettings &value) {
-    switchCountingSettings = value;
-    EEPROM.put(STATE_SWITCH_COUNT_SETTINGS_LOCATION, switchCountingSettings);
+void Settings::restore(const SettingsData &src) {
+    if (memcmp(&data, &src, sizeof (SettingsData)) == 0) return;
+    data = src;
+    markChanged();
+    if (onSettingsChanged != nullptr) {
+        onSettingsChanged();
+    }
 }
 
 #endif
@@ -68,7 +68,7 @@ public:
     SwitchCountingSettings& operator=(SwitchCountingSettings const& src) {
         if (this != &src) {
             switchLimitIntervalSec = src.switchLimitIntervalSec;
-            switchLimitIntervalSec = src.switchLimitIntervalSec;
+            switchMaxCount = src.switchMaxCount;
         }
         return *this;
     }
@@ -81,7 +81,25 @@ public:
 };
 #endif
 
-#define DEFAULT_INTERRUPT_PIN 2
+#ifdef MEM_32KB
+#define MAX_SCENES_COUNT 8
+
+struct RelayScene {
+private:
+    uint16_t mask;
+    uint16_t switchedOn;
+public:
+    RelayScene(uint16_t mask, uint16_t switchedOn) : mask(mask), switchedOn(switchedOn) {}
+    RelayScene() : mask(0), switchedOn(0) {}
+    [[nodiscard]] inline uint16_t getMask() const {
+        return mask;
+    }
+    [[nodiscard]] inline uint16_t getSwitchedOn() const {
+        return switchedOn;
+    }
+};
+#endif
+
 #define RELAYS_COUNT_LOCATION 0
 #define CONTROLLER_ID_LOCATION (RELAYS_COUNT_LOCATION + sizeof (uint8_t))
 #define STATE_FIX_SETTINGS_LOCATION (CONTROLLER_ID_LOCATION + sizeof (uint32_t))
@@ -94,6 +112,9 @@ public:
 #endif
 #define DEFAULT_RELAYS_COUNT 0
 #define MAX_RELAYS_COUNT 16
+#ifdef MEM_32KB
+    #define SCENES_LOCATION (RELAYS_SETTINGS_START_LOCATION + MAX_RELAYS_COUNT * sizeof (RelaySettings))
+#endif
 #define RELAY_PIN_BITS_START 0
 #define RELAY_PIN_BITS_LENGTH 5
 #define RELAY_PIN_BITS_MASK BF_MASK(RELAY_PIN_BITS_START, RELAY_PIN_BITS_LENGTH)
@@ -103,7 +124,7 @@ public:
 #define RELAY_SWITCH_BY_PUSH_BIT (RELAY_INVERSED_BIT + 1)
 #define RELAY_SWITCH_BY_PUSH_BIT_MASK (1 << RELAY_SWITCH_BY_PUSH_BIT)
 
-const uint8_t FORBIDEN_PINS[] = {0, 1, 11, 12, 13};
+constexpr uint8_t FORBIDEN_PINS[] = {0, 1, 11, 12, 13};
 
 inline bool isPinAllowed(uint8_t pin) {
     for (unsigned char i : FORBIDEN_PINS) {
@@ -138,6 +159,10 @@ public:
     [[nodiscard]] inline bool isAllowedPin() const {
         return isPinAllowed(getPin());
     }
+    // enabled pin, which can not be used, is turned off
+    [[nodiscard]] inline PinSettings sanitized() const {
+        return isEnabled() && (!isAllowedPin() || getPin() > A5) ? PinSettings() : *this;
+    }
 };
 
 struct RelaySettings {
@@ -161,45 +186,117 @@ public:
     [[nodiscard]] inline bool isControlPinSwitchByPush() const {
         return controlPinSettings.isBitSet(RELAY_SWITCH_BY_PUSH_BIT_MASK);
     }
+    [[nodiscard]] inline RelaySettings sanitized() const {
+        return RelaySettings(setPinSettings.sanitized().getRaw(), monitorPinSettings.sanitized().getRaw(),
+                             controlPinSettings.sanitized().getRaw());
+    }
 };
 
 
 struct SettingsPtr;
 
+// everything persisted, kept in one block so it is written to EEPROM as a whole
+struct SettingsData {
+    uint8_t relaysCount = DEFAULT_RELAYS_COUNT;
+    uint32_t controllerId = 0;
+    StateFixSettings stateFixSettings;
+#ifdef MEM_32KB
+    //was the control interrupt pin, kept so stored settings keep loading
+    uint8_t reserved = 0;
+    RelayScene scenes[MAX_SCENES_COUNT];
+#endif
+    RelaySettings relaySettings[MAX_RELAYS_COUNT];
+#ifdef MEM_32KB
+    SwitchCountingSettings switchCountingSettings[MAX_RELAYS_COUNT];
+#endif
+};
+
+struct SettingsImageHeader {
+    uint8_t magic;
+    uint8_t version;
+    uint8_t size;
+    uint16_t seq;
+};
+
+/*
+ * Settings are stored as an image in SETTINGS_SLOTS_COUNT slots at the end of EEPROM:
+ * header (magic, version, data size, sequence), SettingsData, CRC-16 of header and data.
+ * Every commit goes to the slot after the active one. On load only headers are scanned, the newest one
+ * is read with a single block read and checked by CRC, so an interrupted commit falls back to the previous slot.
+ * Images of other versions or builds (size differs) are not loaded; settings at the fixed offsets used before
+ * images are migrated. Nothing valid - defaults.
+ * Changes are kept in RAM and committed SETTINGS_COMMIT_DELAY_MILLIS after the last one or on request,
+ * one byte per idle() call when EEPROM is ready; unchanged cells are not rewritten.
+ */
+#define SETTINGS_IMAGE_MAGIC 0xa5
+#define SETTINGS_IMAGE_VERSION 1
+#define SETTINGS_SLOT_SIZE (sizeof (SettingsImageHeader) + sizeof (SettingsData) + sizeof (uint16_t))
+#ifdef MEM_32KB
+#define SETTINGS_SLOTS_COUNT 4
+#else
+#define SETTINGS_SLOTS_COUNT 2
+#endif
+#define SETTINGS_SLOTS_LOCATION (E2END + 1 - SETTINGS_SLOTS_COUNT * SETTINGS_SLOT_SIZE)
+#define SETTINGS_COMMIT_DELAY_MILLIS 5000
+
 
 class Settings {
 public:
     void load();
-    [[nodiscard]] inline uint8_t getRelaysCount() const { return relaysCount; };
-    [[nodiscard]] inline const RelaySettings& getRelaySettingsRef(uint8_t relayIdx) const { return relaySettings[relayIdx]; };
-    [[nodiscard]] inline uint32_t getControllerId() const { return controllerId; }
+    bool idle();
+    inline void commit() { commitRequested = dirty || committing; }
+    [[nodiscard]] inline bool isDirty() const { return dirty || committing; }
+    [[nodiscard]] inline uint8_t getRelaysCount() const { return data.relaysCount; };
+    [[nodiscard]] inline const RelaySettings& getRelaySettingsRef(uint8_t relayIdx) const { return data.relaySettings[relayIdx]; };
+    [[nodiscard]] inline uint32_t getControllerId() const { return data.controllerId; }
     [[nodiscard]] SettingsPtr getRelaysSettingsPtr() const;
-    [[nodiscard]] inline const StateFixSettings &getStateFixSettings() const { return stateFixSettings; }
+    [[nodiscard]] inline const StateFixSettings &getStateFixSettings() const { return data.stateFixSettings; }
 #ifdef MEM_32KB
-    [[nodiscard]] inline uint8_t getControlInterruptPin() const { return controlInterruptPin; }
-    [[nodiscard]] inline const SwitchCountingSettings& getSwitchCountingSettingsRef() const { return switchCountingSettings; }
+    [[nodiscard]] inline const SwitchCountingSettings& getSwitchCountingSettingsRef(uint8_t relayIdx) const {
+        return data.switchCountingSettings[relayIdx];
+    }
+    [[nodiscard]] inline const RelayScene& getSceneRef(uint8_t sceneIdx) const { return data.scenes[sceneIdx]; }
 #endif
     [[nodiscard]] bool isReady() const  { return ready; }
     uint8_t saveRelaySettings(RelaySettings settings[], uint8_t count);
     void saveControllerId(uint32_t value);
     void saveStateFixSettings(const StateFixSettings &stateFixSettings);
 #ifdef MEM_32KB
-    bool saveControlInterruptPin(uint8_t value);
-    void saveSwitchCountingSettings(const SwitchCountingSettings &stateFixSettings);
+    void saveSwitchCountingSettings(uint8_t relayIdx, const SwitchCountingSettings &switchCountingSettings);
+    void saveScene(uint8_t sceneIdx, const RelayScene &scene);
 #endif
     inline void setOnSettingsChanged(void (*value)()) { onSettingsChanged = value; }
+#ifdef MEM_32KB
+    inline void snapshot(SettingsData &dst) const { dst = data; }
+    void restore(const SettingsData &src);
+#endif
 
 private:
     bool ready = false;
-    uint8_t relaysCount;
-    uint32_t controllerId;
-    StateFixSettings stateFixSettings;
-    RelaySettings relaySettings[MAX_RELAYS_COUNT];
-#ifdef MEM_32KB
-    uint8_t controlInterruptPin = DEFAULT_INTERRUPT_PIN;
-    SwitchCountingSettings switchCountingSettings;
-#endif
+    SettingsData data;
+    bool dirty = false;
+    bool committing = false;
+    bool commitRequested = false;
+    uint32_t lastChangeMillis = 0;
+    uint8_t activeSlot = SETTINGS_SLOTS_COUNT - 1;
+    uint16_t activeSeq = 0;
+    SettingsImageHeader commitHeader;
+    uint8_t commitPos = 0;
+    uint16_t commitCrc = 0;
     void (*onSettingsChanged)() = nullptr;
+
+    bool loadImage();
+    bool loadLegacy();
+    void validate();
+    void startCommit();
+    [[nodiscard]] uint8_t getCommitByte(uint8_t pos) const;
+    void markChanged();
+    template<typename T> void change(T &field, const T &value) {
+        if (memcmp(&field, &value, sizeof (T)) != 0) {
+            field = value;
+            markChanged();
+        }
+    }
 };
 
 struct SettingsPtr {
@@ -213,8 +310,9 @@ public:
     [[nodiscard]] inline const RelaySettings& getRelaySettingsRef(uint8_t relayIdx) const { return settings->getRelaySettingsRef(relayIdx); }
     [[nodiscard]] inline const StateFixSettings& getStateFixSettings() const { return settings->getStateFixSettings(); }
 #ifdef MEM_32KB
-    [[nodiscard]] inline uint8_t getControlInterruptPin() const { return settings->getControlInterruptPin(); }
-    [[nodiscard]] inline const SwitchCountingSettings& getSwitchCountingSettingsRef() const { return settings->getSwitchCountingSettingsRef(); }
+    [[nodiscard]] inline const SwitchCountingSettings& getSwitchCountingSettingsRef(uint8_t relayIdx) const {
+        return settings->getSwitchCountingSettingsRef(relayIdx);
+    }
 #endif
 };
 
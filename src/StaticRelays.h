@@ -0,0 +1,149 @@
+#ifndef RELAYCONTROLLER_STATICRELAYS_H
+#define RELAYCONTROLLER_STATICRELAYS_H
+
+#include "Arduino.h"
+#include "Settings.h"
+#include "StaticRelaysConfig.h"
+#include "Hal.h"
+
+/*
+ * STATIC_RELAYS build: relays wiring is taken from STATIC_RELAYS_TABLE instead of EEPROM. Pin validity,
+ * inversion, ports and bit masks are resolved at compile time and pins are read and written by unrolled
+ * templates with constant port registers and masks.
+ */
+
+#define STATIC_SET_PIN 0
+#define STATIC_MONITOR_PIN 1
+#define STATIC_CONTROL_PIN 2
+
+static_assert(STATIC_RELAYS_COUNT <= MAX_RELAYS_COUNT, "too many static relays");
+
+// Arduino pins of ATmega8 and ATmega328P: 0-7 - PD0-PD7, 8-13 - PB0-PB5, A0-A5 - PC0-PC5
+constexpr uint8_t staticPortIdx(uint8_t pin) {
+    return pin < 8 ? PORT_D_IDX : (pin < 14 ? PORT_B_IDX : PORT_C_IDX);
+}
+
+constexpr uint8_t staticPinMask(uint8_t pin) {
+    return 1 << (pin < 8 ? pin : (pin < 14 ? pin - 8 : pin - 14));
+}
+
+constexpr uint8_t staticPin(uint8_t raw) {
+    return raw & RELAY_PIN_BITS_MASK;
+}
+
+constexpr bool isStaticPinForbidden(uint8_t pin, uint8_t i = 0) {
+    return i < sizeof (FORBIDEN_PINS) && (FORBIDEN_PINS[i] == pin || isStaticPinForbidden(pin, i + 1));
+}
+
+constexpr bool isStaticPinUsable(uint8_t raw) {
+    return staticPin(raw) != RELAY_DISABLED_PIN && staticPin(raw) <= A5 && !isStaticPinForbidden(staticPin(raw));
+}
+
+constexpr bool isStaticPinUsable(uint8_t relayIdx, uint8_t kind) {
+    return isStaticPinUsable(STATIC_RELAYS_TABLE[relayIdx][kind]);
+}
+
+constexpr bool isStaticPinInversed(uint8_t relayIdx, uint8_t kind) {
+    return (STATIC_RELAYS_TABLE[relayIdx][kind] & RELAY_INVERSED_BIT_MASK) != 0;
+}
+
+// relays with usable pin of the kind, with all bits of bitsMask set in its settings byte
+constexpr uint16_t staticPinsMask(uint8_t kind, uint8_t bitsMask, uint8_t i = 0) {
+    return i == STATIC_RELAYS_COUNT ? 0 :
+           (isStaticPinUsable(i, kind) && (STATIC_RELAYS_TABLE[i][kind] & bitsMask) == bitsMask ? 1 << i : 0)
+           | staticPinsMask(kind, bitsMask, i + 1);
+}
+
+constexpr uint16_t STATIC_SET_PINS = staticPinsMask(STATIC_SET_PIN, 0);
+constexpr uint16_t STATIC_MONITOR_PINS = staticPinsMask(STATIC_MONITOR_PIN, 0);
+constexpr uint16_t STATIC_MONITOR_INVERSED = staticPinsMask(STATIC_MONITOR_PIN, RELAY_INVERSED_BIT_MASK);
+constexpr uint16_t STATIC_CONTROL_PINS = staticPinsMask(STATIC_CONTROL_PIN, 0);
+constexpr uint16_t STATIC_CONTROL_INVERSED = staticPinsMask(STATIC_CONTROL_PIN, RELAY_INVERSED_BIT_MASK);
+constexpr uint16_t STATIC_SWITCH_BY_PUSH = staticPinsMask(STATIC_CONTROL_PIN, RELAY_SWITCH_BY_PUSH_BIT_MASK);
+// relays which can be switched by the control pin and fixed by the monitor pin
+constexpr uint16_t STATIC_CONTROLLED_RELAYS = STATIC_SET_PINS & STATIC_CONTROL_PINS;
+constexpr uint16_t STATIC_FIXABLE_RELAYS = STATIC_SET_PINS & STATIC_MONITOR_PINS;
+
+template<uint8_t KIND, uint8_t I = 0, bool END = (I >= STATIC_RELAYS_COUNT)>
+struct StaticPinsReader {
+    // high level pins from port snapshot as relay bits, not inversed
+    static inline uint16_t read(const uint8_t ports[]) {
+        return (isStaticPinUsable(I, KIND)
+                && (ports[staticPortIdx(staticPin(STATIC_RELAYS_TABLE[I][KIND]))] & staticPinMask(staticPin(STATIC_RELAYS_TABLE[I][KIND])))
+                ? 1 << I : 0)
+               | StaticPinsReader<KIND, I + 1>::read(ports);
+    }
+};
+
+template<uint8_t KIND, uint8_t I>
+struct StaticPinsReader<KIND, I, true> {
+    static inline uint16_t read(const uint8_t[]) {
+        return 0;
+    }
+};
+
+template<uint8_t KIND, uint8_t I = 0, bool END = (I >= STATIC_RELAYS_COUNT)>
+struct StaticPinPort {
+    // port index of the relay pin, 0 for relays out of the table
+    static inline uint8_t get(uint8_t relayIdx) {
+        return relayIdx == I ? staticPortIdx(staticPin(STATIC_RELAYS_TABLE[I][KIND]))
+                             : StaticPinPort<KIND, I + 1>::get(relayIdx);
+    }
+};
+
+template<uint8_t KIND, uint8_t I>
+struct StaticPinPort<KIND, I, true> {
+    static inline uint8_t get(uint8_t) {
+        return 0;
+    }
+};
+
+template<uint8_t PORT_IDX>
+inline void writeStaticPort(uint8_t mask, bool high) {
+    volatile uint8_t &port = halOutputPort<PORT_IDX>();
+    if (high) {
+        port |= mask;
+    } else {
+        port &= ~mask;
+    }
+}
+
+template<uint8_t I = 0, bool END = (I >= STATIC_RELAYS_COUNT)>
+struct StaticSetPinWriter {
+    static inline void write(uint8_t relayIdx, bool switchedOn) {
+        if (relayIdx == I) {
+            if (isStaticPinUsable(I, STATIC_SET_PIN)) {
+                writeStaticPort<staticPortIdx(staticPin(STATIC_RELAYS_TABLE[I][STATIC_SET_PIN]))>(
+                        staticPinMask(staticPin(STATIC_RELAYS_TABLE[I][STATIC_SET_PIN])),
+                        isStaticPinInversed(I, STATIC_SET_PIN) != switchedOn);
+            }
+        } else {
+            StaticSetPinWriter<I + 1>::write(relayIdx, switchedOn);
+        }
+    }
+};
+
+template<uint8_t I>
+struct StaticSetPinWriter<I, true> {
+    static inline void write(uint8_t, bool) {}
+};
+
+template<uint8_t I = 0, bool END = (I >= STATIC_RELAYS_COUNT)>
+struct StaticSetPinsMasks {
+    // port masks of the set pins to drive low and high for the affected relays
+    static inline void collect(uint16_t affected, uint16_t switchedOn, uint8_t lowMasks[], uint8_t highMasks[]) {
+        if (isStaticPinUsable(I, STATIC_SET_PIN) && (affected & (1 << I))) {
+            uint8_t *masks = isStaticPinInversed(I, STATIC_SET_PIN) != ((switchedOn & (1 << I)) != 0) ? highMasks : lowMasks;
+            masks[staticPortIdx(staticPin(STATIC_RELAYS_TABLE[I][STATIC_SET_PIN]))]
+                    |= staticPinMask(staticPin(STATIC_RELAYS_TABLE[I][STATIC_SET_PIN]));
+        }
+        StaticSetPinsMasks<I + 1>::collect(affected, switchedOn, lowMasks, highMasks);
+    }
+};
+
+template<uint8_t I>
+struct StaticSetPinsMasks<I, true> {
+    static inline void collect(uint16_t, uint16_t, uint8_t[], uint8_t[]) {}
+};
+
+#endif //RELAYCONTROLLER_STATICRELAYS_H
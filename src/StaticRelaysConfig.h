@@ -0,0 +1,15 @@
+#ifndef RELAYCONTROLLER_STATICRELAYSCONFIG_H
+#define RELAYCONTROLLER_STATICRELAYSCONFIG_H
+
+#include "Arduino.h"
+
+// relays wiring for STATIC_RELAYS builds: raw set, monitor and control pin settings bytes, as in IDC_SETTINGS
+constexpr uint8_t STATIC_RELAYS_COUNT = 4;
+constexpr uint8_t STATIC_RELAYS_TABLE[STATIC_RELAYS_COUNT][3] = {
+        {0x08, 0x24, 0x63},
+        {0x05, 0x27, 0x26},
+        {0x09, 0x2f, 0x31},
+        {0x0e, 0x2a, 0x30}
+};
+
+#endif //RELAYCONTROLLER_STATICRELAYSCONFIG_H
@@ -0,0 +1,128 @@
+#include "SwitchHistory.h"
+#include "utils.h"
+
+RingBuffer<uint8_t, SWITCH_HISTORY_BUFFER_SIZE, false> SwitchHistory::buffer;
+uint8_t SwitchHistory::count = 0;
+uint8_t SwitchHistory::sinceKeyframe = 0;
+bool SwitchHistory::keyframeNeeded = true;
+uint32_t SwitchHistory::lastTimeMillis = 0;
+uint16_t SwitchHistory::overflowCount = 0;
+RingBufferPolicy SwitchHistory::policy = RBP_DROP_NEWEST;
+
+void SwitchHistory::add(uint8_t state, uint32_t timeMillis, uint16_t millisOfSecond, uint32_t remoteTimeSec) {
+    uint8_t entry[SWITCH_HISTORY_MAX_ENTRY_SIZE];
+    uint8_t size = 0;
+    uint8_t header = state & (SWITCH_HISTORY_RELAY_MASK | SWITCH_HISTORY_ON_FLAG | SWITCH_HISTORY_INTERNAL_FLAG);
+    uint32_t delta = timeMillis - lastTimeMillis;
+    bool keyframe = keyframeNeeded || sinceKeyframe >= SWITCH_HISTORY_KEYFRAME_INTERVAL
+            || delta > SWITCH_HISTORY_MAX_DELTA_MILLIS;
+    if (keyframe) {
+        entry[size++] = header | SWITCH_HISTORY_KEYFRAME_FLAG;
+        entry[size++] = remoteTimeSec >> 24;
+        entry[size++] = remoteTimeSec >> 16;
+        entry[size++] = remoteTimeSec >> 8;
+        entry[size++] = remoteTimeSec;
+        entry[size++] = millisOfSecond >> 8;
+        entry[size++] = millisOfSecond;
+    } else if (delta == 0) {
+        entry[size++] = header | SWITCH_HISTORY_SAME_TIME_FLAG;
+    } else {
+        entry[size++] = header;
+        while (delta > 0x7f) {
+            entry[size++] = 0x80 | (delta & 0x7f);
+            delta >>= 7;
+        }
+        entry[size++] = delta;
+    }
+
+    if (buffer.getFree() < size) {
+        if (policy != RBP_OVERWRITE_OLDEST) {
+            //deltas stay relative to the last stored entry
+            overflowCount++;
+            return;
+        }
+        while (buffer.getFree() < size) {
+            dropOldestGroup();
+        }
+    }
+    for (uint8_t i = 0; i < size; i++) {
+        buffer.push(entry[i]);
+    }
+    count++;
+    sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+    keyframeNeeded = false;
+    lastTimeMillis = timeMillis;
+}
+
+uint8_t SwitchHistory::getEntrySize() {
+    if (count == 0) {
+        return 0;
+    }
+    return getEntrySizeAt(0);
+}
+
+uint8_t SwitchHistory::getEntrySizeAt(uint8_t offset) {
+    uint8_t header = buffer.peek(offset);
+    if (header & SWITCH_HISTORY_KEYFRAME_FLAG) {
+        return SWITCH_HISTORY_MAX_ENTRY_SIZE;
+    }
+    if (header & SWITCH_HISTORY_SAME_TIME_FLAG) {
+        return 1;
+    }
+    uint8_t size = 1;
+    while (buffer.peek(offset + size) & 0x80) {
+        size++;
+    }
+    return size + 1;
+}
+
+//cut only before a keyframe, so the rest still starts with one
+uint8_t SwitchHistory::countFittingEntries(uint8_t bytes) {
+    uint8_t fitting = 0;
+    uint8_t offset = 0;
+    uint8_t wholeGroups = 0;
+    while (fitting < count) {
+        if (buffer.peek(offset) & SWITCH_HISTORY_KEYFRAME_FLAG) {
+            wholeGroups = fitting;
+        }
+        uint8_t size = getEntrySizeAt(offset);
+        if (size > bytes) {
+            return wholeGroups;
+        }
+        bytes -= size;
+        offset += size;
+        fitting++;
+    }
+    return fitting;
+}
+
+void SwitchHistory::dropOldestGroup() {
+    do {
+        buffer.skip(getEntrySize());
+        count--;
+        overflowCount++;
+    } while (count > 0 && !(buffer.peek(0) & SWITCH_HISTORY_KEYFRAME_FLAG));
+    if (count == 0) {
+        keyframeNeeded = true;
+    }
+}
+
+void SwitchHistory::dropEntry(uint8_t size) {
+    buffer.skip(size);
+    count--;
+    //next dump has to be decodable on its own
+    if (count == 0) {
+        keyframeNeeded = true;
+    }
+}
+
+void SwitchHistory::clear() {
+    buffer.clear();
+    count = 0;
+    overflowCount = 0;
+    keyframeNeeded = true;
+}
+
+void SwitchHistory::resync() {
+    keyframeNeeded = true;
+}
@@ -0,0 +1,61 @@
+#ifndef RELAYCONTROLLER_SWITCHHISTORY_H
+#define RELAYCONTROLLER_SWITCHHISTORY_H
+
+#include "Arduino.h"
+#include "RingBuffer.h"
+
+#define SWITCH_HISTORY_BUFFER_SIZE 250
+#define SWITCH_HISTORY_KEYFRAME_INTERVAL 16
+#define SWITCH_HISTORY_MAX_ENTRY_SIZE 7
+//deltas are written with at most 3 varint bytes, longer gaps start a new keyframe
+#define SWITCH_HISTORY_MAX_DELTA_MILLIS 0x1fffffUL
+
+#define SWITCH_HISTORY_RELAY_MASK 0x0f
+#define SWITCH_HISTORY_ON_FLAG 0x10
+#define SWITCH_HISTORY_INTERNAL_FLAG 0x20
+#define SWITCH_HISTORY_SAME_TIME_FLAG 0x40
+#define SWITCH_HISTORY_KEYFRAME_FLAG 0x80
+
+/*
+ * Switch events packed into a byte ring. Every entry starts with a header byte:
+ *   bits 0-3 - relay index, bit 4 - switched on, bit 5 - internal switch,
+ *   bit 6 - same millisecond as the previous entry, nothing follows,
+ *   bit 7 - keyframe, followed by u32 remote time in seconds and u16 milliseconds of that second (big endian).
+ * Otherwise the header is followed by the milliseconds passed since the previous entry as a varint
+ * (7 bits per byte, least significant group first, bit 7 set on all bytes except the last).
+ * The oldest stored entry is always a keyframe, so any dump can be decoded without earlier data:
+ * when the oldest events are overwritten, the whole group up to the next keyframe is dropped.
+ * IDC_SWITCH_DATA sends the oldest keyframe groups as far as they fit the TX room, the rest stays for the next
+ * read (a group of SWITCH_HISTORY_KEYFRAME_INTERVAL entries takes at most 67 bytes, so one always fits).
+ * Used from the main loop only.
+ */
+class SwitchHistory {
+public:
+    static void add(uint8_t state, uint32_t timeMillis, uint16_t millisOfSecond, uint32_t remoteTimeSec);
+    //size of the oldest entry or 0 when empty, its bytes are read in place before it is dropped
+    static uint8_t getEntrySize();
+    [[nodiscard]] static inline uint8_t getEntryByte(uint8_t pos) { return buffer.peek(pos); }
+    static void dropEntry(uint8_t size);
+    //count of the oldest entries, which fit the given bytes, whole keyframe groups unless all of them fit
+    [[nodiscard]] static uint8_t countFittingEntries(uint8_t bytes);
+    static void clear();
+    static void resync();
+    [[nodiscard]] static inline uint8_t getCount() { return count; }
+    [[nodiscard]] static inline uint16_t getOverflowCount() { return overflowCount; }
+    static inline void setPolicy(RingBufferPolicy value) { policy = value; }
+
+private:
+    static RingBuffer<uint8_t, SWITCH_HISTORY_BUFFER_SIZE, false> buffer;
+    static uint8_t count;
+    static uint8_t sinceKeyframe;
+    static bool keyframeNeeded;
+    static uint32_t lastTimeMillis;
+    static uint16_t overflowCount;
+    static RingBufferPolicy policy;
+
+    static uint8_t getEntrySizeAt(uint8_t offset);
+    static void dropOldestGroup();
+};
+
+
+#endif //RELAYCONTROLLER_SWITCHHISTORY_H
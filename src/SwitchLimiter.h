@@ -0,0 +1,57 @@
+#ifndef RELAYCONTROLLER_SWITCHLIMITER_H
+#define RELAYCONTROLLER_SWITCHLIMITER_H
+
+#include "Arduino.h"
+#include "Settings.h"
+#include "utils.h"
+
+#ifdef MEM_32KB
+
+/*
+ * Allows at most switchMaxCount switches per switchLimitIntervalSec as a token bucket kept in one timestamp
+ * (generic cell rate algorithm): every switch moves nextFreeMillis one emission interval forward, a switch is
+ * refused, when that would move it further than the whole interval ahead. Updated only by switches.
+ */
+struct SwitchLimiter {
+    uint32_t nextFreeMillis = 0;
+
+    // 0 when a switch is allowed now, otherwise millis until the bucket has room again
+    [[nodiscard]] uint32_t getWaitMillis(const SwitchCountingSettings &limit, uint32_t now) const {
+        uint8_t switchMaxCount = limit.getMaxSwitchCount();
+        uint32_t intervalMillis = (uint32_t) MILLIS_PER_SECOND * limit.getSwitchLimitIntervalSec();
+        if (switchMaxCount == 0 || intervalMillis == 0) {
+            return 0;
+        }
+        uint32_t ahead = getAhead(intervalMillis, now);
+        uint32_t emissionMillis = intervalMillis / switchMaxCount;
+        return ahead + emissionMillis > intervalMillis ? ahead + emissionMillis - intervalMillis : 0;
+    }
+
+    // takes the token of an allowed switch
+    void add(const SwitchCountingSettings &limit, uint32_t now) {
+        uint8_t switchMaxCount = limit.getMaxSwitchCount();
+        uint32_t intervalMillis = (uint32_t) MILLIS_PER_SECOND * limit.getSwitchLimitIntervalSec();
+        if (switchMaxCount == 0 || intervalMillis == 0) {
+            return;
+        }
+        nextFreeMillis = now + getAhead(intervalMillis, now) + intervalMillis / switchMaxCount;
+    }
+
+    void clear(uint32_t now) {
+        nextFreeMillis = now;
+    }
+
+private:
+    [[nodiscard]] uint32_t getAhead(uint32_t intervalMillis, uint32_t now) const {
+        uint32_t ahead = nextFreeMillis - now;
+        //already free, or stale after millis() overflow
+        if ((int32_t) ahead < 0 || ahead > intervalMillis) {
+            return 0;
+        }
+        return ahead;
+    }
+};
+
+#endif
+
+#endif //RELAYCONTROLLER_SWITCHLIMITER_H
@@ -0,0 +1,67 @@
+#include "Telemetry.h"
+
+#ifdef MEM_32KB
+
+#include "RelayController.h"
+#include "CommunicationProtocol.h"
+#include "Clock.h"
+
+bool Telemetry::enabled = false;
+bool Telemetry::forced = false;
+uint16_t Telemetry::intervalMillis = 0;
+uint32_t Telemetry::nextMillis = 0;
+uint8_t Telemetry::seq = 0;
+uint16_t Telemetry::lastMasks[4];
+
+void Telemetry::subscribe(bool value, uint16_t interval) {
+    enabled = value;
+    intervalMillis = interval;
+    //the first frame goes right away, so the host starts from the full state
+    forced = true;
+    nextMillis = Clock::getMillis();
+}
+
+bool Telemetry::idle() {
+    if (!enabled) {
+        return false;
+    }
+    uint16_t masks[4] = {
+            RelayController::getMonitorStates(),
+            RelayController::getRelayStates(),
+            RelayController::getControlStates(),
+            RelayController::getTemporaryDisabledControls()
+    };
+    uint32_t now = Clock::getMillis();
+    bool due;
+    if (intervalMillis == 0) {
+        due = forced || memcmp(masks, lastMasks, sizeof (masks)) != 0;
+    } else {
+        due = (int32_t) (now - nextMillis) >= 0;
+    }
+    if (!due) {
+        return false;
+    }
+    TxFrame *frame = startSignal(IDC_TELEMETRY);
+    if (frame == nullptr) {
+        return false;
+    }
+    for (uint16_t mask : masks) {
+        frame->put(mask);
+    }
+    frame->put(RelayController::getRemoteTimeSec());
+    frame->put(seq);
+    TxQueue::commitSignal();
+    seq++;
+    forced = false;
+    memcpy(lastMasks, masks, sizeof (masks));
+    if (intervalMillis != 0) {
+        nextMillis += intervalMillis;
+        //after a stall the period restarts from now instead of sending a burst of frames
+        if ((int32_t) (now - nextMillis) >= 0) {
+            nextMillis = now + intervalMillis;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef RELAYCONTROLLER_TELEMETRY_H
+#define RELAYCONTROLLER_TELEMETRY_H
+
+#include "Arduino.h"
+
+#ifdef MEM_32KB
+
+/*
+ * State telemetry subscription. While subscribed, IDC_TELEMETRY signal with monitor, set, control and
+ * temporary disabled relay masks (u16 each), remote time sec (u32) and sequence number (u8) is pushed every
+ * intervalMillis, or, when intervalMillis is 0, only when some of the masks changed. Masks are taken from
+ * the relay controller bitfields, the pins are not read for it. A frame not fitting the TX queue is retried
+ * in the next round, the sequence number is only advanced by queued frames.
+ */
+class Telemetry {
+public:
+    static void subscribe(bool enabled, uint16_t intervalMillis);
+    static bool idle();
+    [[nodiscard]] static inline bool isEnabled() { return enabled; }
+    [[nodiscard]] static inline uint16_t getIntervalMillis() { return intervalMillis; }
+    [[nodiscard]] static inline uint8_t getSeq() { return seq; }
+
+private:
+    Telemetry() {}
+    static bool enabled;
+    static bool forced;
+    static uint16_t intervalMillis;
+    static uint32_t nextMillis;
+    static uint8_t seq;
+    static uint16_t lastMasks[4];
+};
+
+#endif
+
+#endif //RELAYCONTROLLER_TELEMETRY_H
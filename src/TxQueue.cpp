@@ -0,0 +1,103 @@
+#include "TxQueue.h"
+#include "LatencyHistograms.h"
+
+
+uint8_t TxQueue::responseBuffer[TX_RESPONSE_BUFFER_SIZE];
+uint8_t TxQueue::responseHead = 0;
+uint8_t TxQueue::responseCount = 0;
+TxFrame TxQueue::signals[TX_SIGNAL_SLOTS_COUNT];
+uint8_t TxQueue::signalsHead = 0;
+uint8_t TxQueue::signalsCount = 0;
+uint8_t TxQueue::signalDrainPos = 0;
+uint8_t TxQueue::maxResponseCount = 0;
+uint8_t TxQueue::maxSignalsCount = 0;
+uint16_t TxQueue::droppedSignalsCount = 0;
+uint16_t TxQueue::responseOverflowCount = 0;
+bool TxQueue::signalsHeld = false;
+
+void TxQueue::putResponse(uint8_t value) {
+    if (responseCount == TX_RESPONSE_BUFFER_SIZE) {
+        //the UART takes what fits its buffer, it is never waited for
+        drain();
+        if (responseCount == TX_RESPONSE_BUFFER_SIZE) {
+            responseOverflowCount++;
+            return;
+        }
+    }
+    uint8_t tail = (responseHead + responseCount) % TX_RESPONSE_BUFFER_SIZE;
+    responseBuffer[tail] = value;
+    responseCount++;
+    if (responseCount > maxResponseCount) {
+        maxResponseCount = responseCount;
+    }
+}
+
+uint8_t TxQueue::getResponseRoom() {
+    int uartFree = Serial.availableForWrite();
+    //a started signal is finished before any response byte
+    if (signalDrainPos != 0) {
+        uartFree -= signals[signalsHead].size - signalDrainPos;
+    }
+    uint16_t room = TX_RESPONSE_BUFFER_SIZE - responseCount;
+    if (uartFree > 0) {
+        room += uartFree;
+    }
+    return room > 0xff ? 0xff : room;
+}
+
+TxFrame *TxQueue::beginSignal() {
+    if (signalsCount == TX_SIGNAL_SLOTS_COUNT) {
+        droppedSignalsCount++;
+        return nullptr;
+    }
+    TxFrame *frame = &signals[(signalsHead + signalsCount) % TX_SIGNAL_SLOTS_COUNT];
+    frame->size = 0;
+    return frame;
+}
+
+void TxQueue::commitSignal() {
+    signalsCount++;
+    if (signalsCount > maxSignalsCount) {
+        maxSignalsCount = signalsCount;
+    }
+}
+
+bool TxQueue::drainByte() {
+    //signal, which was started, is finished first, so it is never split by a response
+    if (signalDrainPos == 0 && responseCount > 0) {
+        Serial.write(responseBuffer[responseHead]);
+        responseHead = (responseHead + 1) % TX_RESPONSE_BUFFER_SIZE;
+        responseCount--;
+        return true;
+    }
+    if (signalsCount > 0 && (signalDrainPos != 0 || !signalsHeld)) {
+        const TxFrame &frame = signals[signalsHead];
+        Serial.write(frame.data[signalDrainPos++]);
+        if (signalDrainPos >= frame.size) {
+            signalDrainPos = 0;
+            signalsHead = (signalsHead + 1) % TX_SIGNAL_SLOTS_COUNT;
+            signalsCount--;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TxQueue::drain() {
+    PHASE_START(LP_TX, txStart);
+    int freeSpace = Serial.availableForWrite();
+    bool drained = false;
+    while (freeSpace > 0 && drainByte()) {
+        freeSpace--;
+        drained = true;
+    }
+    PHASE_END(LP_TX, txStart);
+    return drained;
+}
+
+void TxQueue::clearStatistics() {
+    maxResponseCount = responseCount;
+    maxSignalsCount = signalsCount;
+    droppedSignalsCount = 0;
+    responseOverflowCount = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef RELAYCONTROLLER_TXQUEUE_H
+#define RELAYCONTROLLER_TXQUEUE_H
+
+#include "Arduino.h"
+
+#ifdef MEM_32KB
+#define TX_RESPONSE_BUFFER_SIZE 128
+#define TX_SIGNAL_SLOTS_COUNT 8
+#else
+#define TX_RESPONSE_BUFFER_SIZE 48
+#define TX_SIGNAL_SLOTS_COUNT 4
+#endif
+#ifdef MEM_32KB
+//fits the telemetry signal
+#define TX_SIGNAL_FRAME_SIZE 16
+//IC_NONE, instruction code, data code, request id
+#define TX_RESPONSE_HEADER_SIZE 7
+#else
+#define TX_SIGNAL_FRAME_SIZE 12
+#define TX_RESPONSE_HEADER_SIZE 3
+#endif
+//the largest response of a fixed size: IDC_FIX_DATA of MAX_RELAYS_COUNT relays
+#define TX_MAX_RESPONSE_SIZE (TX_RESPONSE_HEADER_SIZE + 1 + 16 * 5)
+
+struct TxFrame {
+    uint8_t size;
+    uint8_t data[TX_SIGNAL_FRAME_SIZE];
+
+    inline void put(uint8_t value) {
+        if (size < TX_SIGNAL_FRAME_SIZE) {
+            data[size++] = value;
+        }
+    }
+    inline void put(uint16_t value) {
+        put((uint8_t) (value >> 8));
+        put((uint8_t) (value & 0xFF));
+    }
+    inline void put(uint32_t value) {
+        put((uint16_t) (value >> 16));
+        put((uint16_t) (value & 0xFFFF));
+    }
+};
+
+/*
+ * Outgoing data is queued here and moved to the HardwareSerial TX buffer only as far as it has free space,
+ * so sending never waits for the UART. Responses have priority over signals; signals are kept as whole
+ * frames and never interleave with a response, also not with one held open over several rounds.
+ * When no signal slot is free, the new signal is dropped. Responses are started only when getResponseRoom()
+ * fits them (the server waits for TX_MAX_RESPONSE_SIZE, longer responses are cut to the room), a response
+ * byte which still does not fit the response buffer and the UART is dropped and counted as an overflow.
+ */
+class TxQueue {
+public:
+    static void putResponse(uint8_t value);
+    //response bytes, which fit the response buffer and the UART TX buffer without waiting
+    [[nodiscard]] static uint8_t getResponseRoom();
+    //signals are not started while a response is held open
+    static inline void holdSignals(bool value) { signalsHeld = value; }
+    static TxFrame *beginSignal();
+    static void commitSignal();
+    static bool drain();
+    [[nodiscard]] static inline uint8_t getResponseDepth() { return responseCount; }
+    [[nodiscard]] static inline uint8_t getMaxResponseDepth() { return maxResponseCount; }
+    [[nodiscard]] static inline uint8_t getSignalDepth() { return signalsCount; }
+    [[nodiscard]] static inline uint8_t getMaxSignalDepth() { return maxSignalsCount; }
+    [[nodiscard]] static inline uint16_t getDroppedSignalsCount() { return droppedSignalsCount; }
+    [[nodiscard]] static inline uint16_t getResponseOverflowCount() { return responseOverflowCount; }
+    static void clearStatistics();
+
+private:
+    TxQueue() {}
+    static uint8_t responseBuffer[TX_RESPONSE_BUFFER_SIZE];
+    static uint8_t responseHead;
+    static uint8_t responseCount;
+    static TxFrame signals[TX_SIGNAL_SLOTS_COUNT];
+    static uint8_t signalsHead;
+    static uint8_t signalsCount;
+    static uint8_t signalDrainPos;
+    static uint8_t maxResponseCount;
+    static uint8_t maxSignalsCount;
+    static uint16_t droppedSignalsCount;
+    static uint16_t responseOverflowCount;
+    static bool signalsHeld;
+
+    static bool drainByte();
+};
+
+
+#endif //RELAYCONTROLLER_TXQUEUE_H
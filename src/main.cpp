@@ -1,21 +1,17 @@
 #include <Arduino.h>
 #include "Settings.h"
-#include "RelayController.h"
 #include "Server.h"
+#include "Scheduler.h"
+#include "FirmwareSetup.h"
 
 Settings data;
 Server server(data);
 
 
 void setup() {
-    Serial.begin(18200);
-    delay(100);
-    data.load();
-    RelayController::setup(data);
-    server.setup();
+    setupFirmware(data, server);
 }
 
 void loop() {
-    RelayController::idle();
-    server.idle();
-}
\ No newline at end of file
+    Scheduler::run();
+}
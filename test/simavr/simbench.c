@@ -0,0 +1,365 @@
+/*
+ * Runs a firmware ELF of the *_sim envs under simavr, drives its UART and input pins by a traffic script and counts
+ * CPU cycles between the loop phase markers written by halSimMarker(). The cycles of every LP_COMMAND_EXECUTE are
+ * also counted for the command of the script, which is waiting for it.
+ * Results are written as "<name> <count> <min> <mean> <max>" lines, names are phase.<phase> and command.<label>.
+ *
+ * usage: simbench -m <mcu> -f <frequency> [-M] -s <traffic script> -o <results> <firmware.elf>
+ *   -M  MEM_32KB build: framed commands carry an id and "mem32" lines of the script are run
+ *
+ * Script lines, codes and bytes in hex:
+ *   wait <ms>                                      run the MCU for <ms> milliseconds
+ *   pin <arduino pin> <0|1>                        drive an input pin
+ *   cmd <label> <main code> <data code> [args]     send a framed command, run until it was executed and answered
+ *   mem32 <line>                                   the line is run by MEM_32KB builds only
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "avr_uart.h"
+#include "avr_ioport.h"
+
+//the same as in CommunicationProtocol.h and LatencyHistograms.h
+#define FRAME_START 0xaa
+#define SIM_MARKER_START 0x80
+#define LP_COMMAND_EXECUTE 4
+#define LP_COUNT 7
+
+#define MAX_COMMANDS 64
+#define MAX_FRAME_SIZE 60
+#define MAX_RESPONSE_SIZE 256
+#define COMMAND_TIMEOUT_MS 500
+#define RESPONSE_IDLE_MS 5
+
+static const char *PHASE_NAMES[LP_COUNT] = {
+        "input_scan", "control", "state_fix", "command_parse", "command_execute", "tx", "loop"
+};
+
+struct Stats {
+    char name[40];
+    uint32_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t total;
+};
+
+static struct Stats phases[LP_COUNT];
+static struct Stats commands[MAX_COMMANDS];
+static int commandsCount = 0;
+
+static avr_cycle_count_t phaseStart[LP_COUNT];
+static int phaseOpen[LP_COUNT];
+//command of the script waiting for its LP_COMMAND_EXECUTE
+static struct Stats *pendingCommand = NULL;
+static int commandExecuted = 0;
+
+static uint8_t response[MAX_RESPONSE_SIZE];
+static int responseSize = 0;
+static avr_cycle_count_t lastTxCycle = 0;
+
+static avr_t *avr = NULL;
+static avr_irq_t *uartInput = NULL;
+static int mem32 = 0;
+static uint32_t commandId = 0;
+
+static void fail(const char *message, int line) {
+    if (line > 0) {
+        fprintf(stderr, "simbench: line %d: %s\n", line, message);
+    } else {
+        fprintf(stderr, "simbench: %s\n", message);
+    }
+    exit(2);
+}
+
+static void addCycles(struct Stats *stats, uint64_t cycles) {
+    if (stats->count == 0 || cycles < stats->min) {
+        stats->min = cycles;
+    }
+    if (cycles > stats->max) {
+        stats->max = cycles;
+    }
+    stats->total += cycles;
+    stats->count++;
+}
+
+static struct Stats *findCommand(const char *label) {
+    for (int i = 0; i < commandsCount; i++) {
+        if (strcmp(commands[i].name + strlen("command."), label) == 0) {
+            return &commands[i];
+        }
+    }
+    if (commandsCount == MAX_COMMANDS) {
+        fail("too many command labels", 0);
+    }
+    struct Stats *stats = &commands[commandsCount++];
+    snprintf(stats->name, sizeof(stats->name), "command.%s", label);
+    return stats;
+}
+
+//marker register of halSimMarker(): GPIOR0, the ATmega8 has TWAR instead
+static avr_io_addr_t markerAddress(const char *mcu) {
+    return strcmp(mcu, "atmega8") == 0 ? 0x22 : 0x3e;
+}
+
+static void markerWrite(struct avr_t *core, avr_io_addr_t addr, uint8_t value, void *param) {
+    core->data[addr] = value;
+    uint8_t phase = value & ~SIM_MARKER_START;
+    if (phase >= LP_COUNT) return;
+    if (value & SIM_MARKER_START) {
+        phaseStart[phase] = core->cycle;
+        phaseOpen[phase] = 1;
+        return;
+    }
+    if (!phaseOpen[phase]) return;
+    phaseOpen[phase] = 0;
+    uint64_t cycles = core->cycle - phaseStart[phase];
+    addCycles(&phases[phase], cycles);
+    if (phase == LP_COMMAND_EXECUTE && pendingCommand != NULL) {
+        addCycles(pendingCommand, cycles);
+        pendingCommand = NULL;
+        commandExecuted = 1;
+    }
+}
+
+static void uartOutput(struct avr_irq_t *irq, uint32_t value, void *param) {
+    if (responseSize < MAX_RESPONSE_SIZE) {
+        response[responseSize++] = (uint8_t) value;
+    }
+    lastTxCycle = avr->cycle;
+}
+
+static avr_cycle_count_t millisToCycles(uint32_t millis) {
+    return (avr_cycle_count_t) millis * (avr->frequency / 1000);
+}
+
+static void runUntil(avr_cycle_count_t endCycle, int (*done)(void)) {
+    while (avr->cycle < endCycle) {
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed) {
+            fail("the MCU stopped", 0);
+        }
+        if (done != NULL && done()) return;
+    }
+}
+
+static int isCommandExecuted(void) {
+    return commandExecuted;
+}
+
+static int isResponseComplete(void) {
+    return responseSize > 0 && avr->cycle - lastTxCycle > millisToCycles(RESPONSE_IDLE_MS);
+}
+
+//CRC-8 of updateFrameCrc(), polynomial 0x07
+static uint8_t updateFrameCrc(uint8_t crc, uint8_t value) {
+    crc ^= value;
+    for (int i = 0; i < 8; i++) {
+        crc = crc & 0x80 ? (uint8_t) ((crc << 1) ^ 0x07) : (uint8_t) (crc << 1);
+    }
+    return crc;
+}
+
+static uint8_t parseByte(const char *token, int line) {
+    char *end;
+    unsigned long value = strtoul(token, &end, 16);
+    if (*end != '\0' || value > 0xff) {
+        fail("not a hex byte", line);
+    }
+    return (uint8_t) value;
+}
+
+static void sendCommand(char **tokens, int count, int line) {
+    if (count < 4) {
+        fail("cmd needs a label, main code and data code", line);
+    }
+    uint8_t payload[MAX_FRAME_SIZE];
+    int size = 0;
+    payload[size++] = parseByte(tokens[2], line);
+    payload[size++] = parseByte(tokens[3], line);
+    if (mem32) {
+        commandId++;
+        payload[size++] = (uint8_t) (commandId >> 24);
+        payload[size++] = (uint8_t) (commandId >> 16);
+        payload[size++] = (uint8_t) (commandId >> 8);
+        payload[size++] = (uint8_t) commandId;
+    }
+    for (int i = 4; i < count; i++) {
+        //the whole frame has to fit the RX FIFO of the simulated UART
+        if (size == MAX_FRAME_SIZE) {
+            fail("command is too long", line);
+        }
+        payload[size++] = parseByte(tokens[i], line);
+    }
+    uint8_t crc = updateFrameCrc(0, (uint8_t) size);
+    avr_raise_irq(uartInput, FRAME_START);
+    avr_raise_irq(uartInput, (uint32_t) size);
+    for (int i = 0; i < size; i++) {
+        crc = updateFrameCrc(crc, payload[i]);
+        avr_raise_irq(uartInput, payload[i]);
+    }
+    avr_raise_irq(uartInput, crc);
+
+    pendingCommand = findCommand(tokens[1]);
+    commandExecuted = 0;
+    responseSize = 0;
+    runUntil(avr->cycle + millisToCycles(COMMAND_TIMEOUT_MS), isCommandExecuted);
+    if (!commandExecuted) {
+        fail("command was not executed", line);
+    }
+    runUntil(avr->cycle + millisToCycles(COMMAND_TIMEOUT_MS), isResponseComplete);
+    printf("%-28s", tokens[1]);
+    for (int i = 0; i < responseSize; i++) {
+        printf(" %02x", response[i]);
+    }
+    printf("\n");
+}
+
+static void drivePin(char **tokens, int count, int line) {
+    if (count != 3) {
+        fail("pin needs an arduino pin and a level", line);
+    }
+    int pin = atoi(tokens[1]);
+    char port;
+    int bit;
+    if (pin >= 2 && pin < 8) {
+        port = 'D';
+        bit = pin;
+    } else if (pin >= 8 && pin < 14) {
+        port = 'B';
+        bit = pin - 8;
+    } else if (pin >= 14 && pin < 20) {
+        port = 'C';
+        bit = pin - 14;
+    } else {
+        fail("pin is not an input pin", line);
+        return;
+    }
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit), atoi(tokens[2]) ? 1 : 0);
+}
+
+static void runScript(const char *path) {
+    FILE *script = fopen(path, "r");
+    if (script == NULL) {
+        fail("can not open the traffic script", 0);
+    }
+    char buff[512];
+    int line = 0;
+    while (fgets(buff, sizeof(buff), script) != NULL) {
+        line++;
+        char *tokens[MAX_FRAME_SIZE + 4];
+        int count = 0;
+        for (char *token = strtok(buff, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n")) {
+            if (count == MAX_FRAME_SIZE + 4) {
+                fail("line is too long", line);
+            }
+            tokens[count++] = token;
+        }
+        if (count == 0 || tokens[0][0] == '#') continue;
+        char **lineTokens = tokens;
+        if (strcmp(tokens[0], "mem32") == 0) {
+            if (!mem32) continue;
+            lineTokens++;
+            count--;
+            if (count == 0) continue;
+        }
+        if (strcmp(lineTokens[0], "wait") == 0 && count == 2) {
+            runUntil(avr->cycle + millisToCycles((uint32_t) atoi(lineTokens[1])), NULL);
+        } else if (strcmp(lineTokens[0], "pin") == 0) {
+            drivePin(lineTokens, count, line);
+        } else if (strcmp(lineTokens[0], "cmd") == 0) {
+            sendCommand(lineTokens, count, line);
+        } else {
+            fail("unknown line", line);
+        }
+    }
+    fclose(script);
+}
+
+static void writeStats(FILE *out, const struct Stats *stats) {
+    if (stats->count == 0) return;
+    fprintf(out, "%s %u %llu %llu %llu\n", stats->name, stats->count, (unsigned long long) stats->min,
+            (unsigned long long) (stats->total / stats->count), (unsigned long long) stats->max);
+}
+
+static void writeResults(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        fail("can not write the results", 0);
+    }
+    fprintf(out, "# name count min mean max, CPU cycles\n");
+    for (int i = 0; i < LP_COUNT; i++) {
+        writeStats(out, &phases[i]);
+    }
+    for (int i = 0; i < commandsCount; i++) {
+        writeStats(out, &commands[i]);
+    }
+    fclose(out);
+}
+
+int main(int argc, char *argv[]) {
+    const char *mcu = NULL;
+    const char *scriptPath = NULL;
+    const char *resultsPath = NULL;
+    uint32_t frequency = 0;
+    int option;
+    while ((option = getopt(argc, argv, "m:f:Ms:o:")) != -1) {
+        switch (option) {
+            case 'm':
+                mcu = optarg;
+                break;
+            case 'f':
+                frequency = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'M':
+                mem32 = 1;
+                break;
+            case 's':
+                scriptPath = optarg;
+                break;
+            case 'o':
+                resultsPath = optarg;
+                break;
+            default:
+                fail("usage: simbench -m <mcu> -f <frequency> [-M] -s <script> -o <results> <firmware.elf>", 0);
+        }
+    }
+    if (mcu == NULL || frequency == 0 || scriptPath == NULL || resultsPath == NULL || optind != argc - 1) {
+        fail("usage: simbench -m <mcu> -f <frequency> [-M] -s <script> -o <results> <firmware.elf>", 0);
+    }
+    for (int i = 0; i < LP_COUNT; i++) {
+        snprintf(phases[i].name, sizeof(phases[i].name), "phase.%s", PHASE_NAMES[i]);
+    }
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[optind], &firmware) != 0) {
+        fail("can not read the firmware", 0);
+    }
+    avr = avr_make_mcu_by_name(mcu);
+    if (avr == NULL) {
+        fail("unknown MCU", 0);
+    }
+    avr_init(avr);
+    firmware.frequency = frequency;
+    avr_load_firmware(avr, &firmware);
+    avr->frequency = frequency;
+
+    avr_register_io_write(avr, markerAddress(mcu), markerWrite, NULL);
+    //responses are collected here instead of the simavr console
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+    uartInput = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), uartOutput, NULL);
+
+    runScript(scriptPath);
+    writeResults(resultsPath);
+    return 0;
+}
@@ -0,0 +1,101 @@
+# Extra script of the *_sim envs, adds the simbench target: pio run -e ATmega8_sim -t simbench
+# The firmware runs under simavr against traffic.txt, its cycles are compared with baseline_<env>.txt and a phase or
+# command slower than the baseline fails the target. SIMBENCH_UPDATE=1 writes the baseline from the run instead.
+# Needs simavr with its headers and libsimavr, a host C compiler and pkg-config.
+Import("env")
+
+import os
+import shutil
+import subprocess
+
+HARNESS_DIR = os.path.join(env.subst("$PROJECT_DIR"), "test", "simavr")
+# the simulation is exact, the slack only absorbs interrupts shifting between phases when unrelated code moves
+TOLERANCE = 0.05
+MIN_SLACK_CYCLES = 16
+
+
+def simavr_flags():
+    try:
+        return subprocess.check_output(["pkg-config", "--cflags", "--libs", "simavr"], text=True).split()
+    except (OSError, subprocess.CalledProcessError):
+        return ["-I/usr/include/simavr", "-I/usr/local/include/simavr", "-lsimavr", "-lelf"]
+
+
+def is_mem_32kb(env):
+    defines = [define[0] if isinstance(define, (list, tuple)) else define for define in env.get("CPPDEFINES", [])]
+    return "MEM_32KB" in defines
+
+
+# name: (count, min, mean, max)
+def read_results(path):
+    results = {}
+    with open(path) as file:
+        for line in file:
+            fields = line.split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            results[fields[0]] = tuple(int(value) for value in fields[1:])
+    return results
+
+
+def is_regression(measured, baseline):
+    return measured > baseline + max(MIN_SLACK_CYCLES, baseline * TOLERANCE)
+
+
+def compare(results, baseline):
+    failed = False
+    print("%-40s %12s %12s %12s %12s" % ("", "mean", "base mean", "max", "base max"))
+    for name, (_, _, base_mean, base_max) in baseline.items():
+        if name not in results:
+            print("%-40s not measured" % name)
+            failed = True
+            continue
+        _, _, mean, maximum = results[name]
+        regression = is_regression(mean, base_mean) or is_regression(maximum, base_max)
+        failed |= regression
+        print("%-40s %12d %12d %12d %12d%s" % (name, mean, base_mean, maximum, base_max,
+                                               "  REGRESSION" if regression else ""))
+    for name in results:
+        if name not in baseline:
+            print("%-40s not in the baseline" % name)
+    return failed
+
+
+def run_simbench(target, source, env):
+    build_dir = env.subst("$BUILD_DIR")
+    harness = os.path.join(build_dir, "simbench")
+    if subprocess.call(["cc", "-std=gnu99", "-O2", "-o", harness, os.path.join(HARNESS_DIR, "simbench.c")]
+                       + simavr_flags()) != 0:
+        return 1
+
+    board = env.BoardConfig()
+    results_path = os.path.join(build_dir, "simbench.txt")
+    command = [harness, "-m", board.get("build.mcu"), "-f", board.get("build.f_cpu").rstrip("L"),
+               "-s", os.path.join(HARNESS_DIR, "traffic.txt"), "-o", results_path]
+    if is_mem_32kb(env):
+        command.append("-M")
+    command.append(str(source[0]))
+    if subprocess.call(command) != 0:
+        return 1
+
+    baseline_path = os.path.join(HARNESS_DIR, "baseline_%s.txt" % env.subst("$PIOENV"))
+    if os.environ.get("SIMBENCH_UPDATE"):
+        shutil.copyfile(results_path, baseline_path)
+        print("baseline written to %s" % baseline_path)
+        return 0
+    if not os.path.exists(baseline_path):
+        print("no baseline %s, run with SIMBENCH_UPDATE=1 and commit it" % baseline_path)
+        return 1
+    if compare(read_results(results_path), read_results(baseline_path)):
+        print("cycles regressed against %s" % baseline_path)
+        return 1
+    return 0
+
+
+env.AddCustomTarget(
+    name="simbench",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=[run_simbench],
+    title="Simbench",
+    description="Cycle counts under simavr compared with the committed baseline"
+)
@@ -0,0 +1,130 @@
+#ifndef RELAYCONTROLLER_FIRMWAREHARNESS_H
+#define RELAYCONTROLLER_FIRMWAREHARNESS_H
+
+#include <Arduino.h>
+#include <vector>
+#include <new>
+#include "NativeSim.h"
+#include "Settings.h"
+#include "RelayController.h"
+#include "Server.h"
+#include "Scheduler.h"
+#include "Clock.h"
+#include "TxQueue.h"
+#include "CommunicationProtocol.h"
+#include "FirmwareSetup.h"
+
+/*
+ * The firmware of main.cpp on the simulated MCU of the native env. Every loop round costs
+ * FIRMWARE_ROUND_MICROS of virtual time on top of the idle sleeps, so polling loops still move the clock.
+ * Commands are sent as frames, responses are found in the bytes the host received.
+ */
+#define FIRMWARE_ROUND_MICROS 100
+
+class Firmware {
+public:
+    static inline Settings settings;
+    static inline Server server{settings};
+    static inline uint32_t rounds = 0;
+
+    // power on with the EEPROM content kept, through setupFirmware() like main.cpp
+    static void boot() {
+        server.~Server();
+        new (&server) Server(settings);
+        setupFirmware(settings, server);
+        runFor(10);
+        NativeSim::serialReceived().clear();
+        rounds = 0;
+    }
+
+    static void round() {
+        Scheduler::run();
+        NativeSim::advanceMicros(FIRMWARE_ROUND_MICROS);
+        rounds++;
+    }
+
+    static void runFor(uint32_t millis) {
+        uint32_t start = NativeSim::nowMicros();
+        while (NativeSim::nowMicros() - start < millis * 1000) {
+            round();
+        }
+    }
+
+    // rounds until the condition holds or the time is up, returns the condition
+    template<typename Condition>
+    static bool runUntil(Condition condition, uint32_t maxMillis) {
+        uint32_t start = NativeSim::nowMicros();
+        while (!condition()) {
+            if (NativeSim::nowMicros() - start >= maxMillis * 1000) {
+                return false;
+            }
+            round();
+        }
+        return true;
+    }
+
+    // relays with set, monitor and control pins, 0xff means no pin
+    static void configureRelays(uint8_t count, const uint8_t setPins[], const uint8_t monitorPins[],
+                                const uint8_t controlPins[]) {
+        RelaySettings relays[MAX_RELAYS_COUNT];
+        for (uint8_t i = 0; i < count; i++) {
+            relays[i] = RelaySettings(toPinSettings(setPins[i]), toPinSettings(monitorPins[i]),
+                                      toPinSettings(controlPins[i]));
+        }
+        settings.saveRelaySettings(relays, count);
+        settings.commit();
+        runUntil([]() { return !settings.isDirty(); }, 1000);
+    }
+
+    static std::vector<uint8_t> frame(InstructionCode mainCode, InstructionDataCode code, uint32_t id,
+                                      const std::vector<uint8_t> &args = {}) {
+        std::vector<uint8_t> payload = {(uint8_t) mainCode, (uint8_t) code,
+                                        (uint8_t) (id >> 24), (uint8_t) (id >> 16), (uint8_t) (id >> 8), (uint8_t) id};
+        payload.insert(payload.end(), args.begin(), args.end());
+        std::vector<uint8_t> result = {FRAME_START, (uint8_t) payload.size()};
+        uint8_t crc = updateFrameCrc(0, (uint8_t) payload.size());
+        for (uint8_t value : payload) {
+            crc = updateFrameCrc(crc, value);
+        }
+        result.insert(result.end(), payload.begin(), payload.end());
+        result.push_back(crc);
+        return result;
+    }
+
+    static void send(const std::vector<uint8_t> &bytes) {
+        NativeSim::serialSend(bytes.data(), bytes.size());
+    }
+
+    static void sendCommand(InstructionCode mainCode, InstructionDataCode code, uint32_t id,
+                            const std::vector<uint8_t> &args = {}) {
+        send(frame(mainCode, code, id, args));
+    }
+
+    // position of IC_NONE, instruction code, data code, id in the received bytes, -1 when not there
+    static int findResponse(InstructionCode instructionCode, InstructionDataCode code, uint32_t id, size_t from = 0) {
+        std::vector<uint8_t> header = {IC_NONE, (uint8_t) instructionCode, (uint8_t) code,
+                                       (uint8_t) (id >> 24), (uint8_t) (id >> 16), (uint8_t) (id >> 8), (uint8_t) id};
+        return find(header, from);
+    }
+
+    static int findSignal(InstructionDataCode code, size_t from = 0) {
+        return find({IC_NONE, IC_SIGNAL, (uint8_t) code}, from);
+    }
+
+    static int find(const std::vector<uint8_t> &bytes, size_t from = 0) {
+        std::vector<uint8_t> &received = NativeSim::serialReceived();
+        for (size_t i = from; i + bytes.size() <= received.size(); i++) {
+            if (memcmp(received.data() + i, bytes.data(), bytes.size()) == 0) {
+                return (int) i;
+            }
+        }
+        return -1;
+    }
+
+private:
+    static uint8_t toPinSettings(uint8_t pin) {
+        return pin == 0xff ? RELAY_DISABLED_PIN : pin;
+    }
+};
+
+#endif //RELAYCONTROLLER_FIRMWAREHARNESS_H
@@ -0,0 +1,77 @@
+#ifndef RELAYCONTROLLER_SWITCHHISTORYDECODER_H
+#define RELAYCONTROLLER_SWITCHHISTORYDECODER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "SwitchHistory.h"
+
+struct SwitchEvent {
+    uint8_t relayIdx;
+    bool switchedOn;
+    bool internal;
+    // remote time in milliseconds
+    uint64_t timeMillis;
+
+    bool operator==(const SwitchEvent &other) const {
+        return relayIdx == other.relayIdx && switchedOn == other.switchedOn && internal == other.internal
+               && timeMillis == other.timeMillis;
+    }
+};
+
+/*
+ * Host side decoder of IDC_SWITCH_DATA: entry count (u8), the entries as documented in SwitchHistory.h,
+ * overflow count (u16, big endian). Returns false, when the data is malformed.
+ */
+class SwitchHistoryDecoder {
+public:
+    static bool decode(const uint8_t *data, size_t size, std::vector<SwitchEvent> &events, uint16_t &overflowCount) {
+        if (size < 1) {
+            return false;
+        }
+        uint8_t count = data[0];
+        size_t pos = 1;
+        uint64_t timeMillis = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (pos >= size) {
+                return false;
+            }
+            uint8_t header = data[pos++];
+            if (header & SWITCH_HISTORY_KEYFRAME_FLAG) {
+                if (pos + 6 > size) {
+                    return false;
+                }
+                uint32_t sec = (uint32_t) data[pos] << 24 | (uint32_t) data[pos + 1] << 16
+                        | (uint32_t) data[pos + 2] << 8 | data[pos + 3];
+                uint16_t millisOfSecond = (uint16_t) (data[pos + 4] << 8 | data[pos + 5]);
+                pos += 6;
+                timeMillis = (uint64_t) sec * 1000 + millisOfSecond;
+            } else if (i == 0) {
+                //every dump starts with a keyframe
+                return false;
+            } else if (!(header & SWITCH_HISTORY_SAME_TIME_FLAG)) {
+                uint32_t delta = 0;
+                uint8_t shift = 0;
+                uint8_t value;
+                do {
+                    if (pos >= size || shift > 21) {
+                        return false;
+                    }
+                    value = data[pos++];
+                    delta |= (uint32_t) (value & 0x7f) << shift;
+                    shift += 7;
+                } while (value & 0x80);
+                timeMillis += delta;
+            }
+            events.push_back({(uint8_t) (header & SWITCH_HISTORY_RELAY_MASK), (header & SWITCH_HISTORY_ON_FLAG) != 0,
+                              (header & SWITCH_HISTORY_INTERNAL_FLAG) != 0, timeMillis});
+        }
+        if (pos + 2 != size) {
+            return false;
+        }
+        overflowCount = (uint16_t) (data[pos] << 8 | data[pos + 1]);
+        return true;
+    }
+};
+
+#endif //RELAYCONTROLLER_SWITCHHISTORYDECODER_H
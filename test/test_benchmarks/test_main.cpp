@@ -0,0 +1,302 @@
+#include <unity.h>
+#include <chrono>
+#include <stdio.h>
+#include "../support/FirmwareHarness.h"
+
+/*
+ * Workloads replayed on the simulated MCU: input storms on the control pins, command floods at the full
+ * baud rate and settings rewrites. Reported numbers are loop rounds, commands per second of virtual and host
+ * time and the virtual latency from an input edge to the relay output. Virtual time counts only sleeps and
+ * FIRMWARE_ROUND_MICROS per round, so latencies measure scheduling, not AVR instruction timing.
+ * The assertions are loose bounds, which catch regressions like lost events or stalled loops.
+ */
+
+#define RELAYS 4
+#define CONTACT_DELAY_MICROS 5000
+
+const uint8_t SET_PINS[RELAYS] = {3, 4, 5, 6};
+const uint8_t MONITOR_PINS[RELAYS] = {7, 8, 9, 10};
+const uint8_t CONTROL_PINS[RELAYS] = {A0, A1, A2, A3};
+
+typedef std::chrono::steady_clock HostClock;
+
+void report(const char *name, const char *format, double a, double b = 0, double c = 0, double d = 0) {
+    char line[160];
+    int size = snprintf(line, sizeof line, "BENCH %s: ", name);
+    snprintf(line + size, sizeof line - size, format, a, b, c, d);
+    TEST_MESSAGE(line);
+}
+
+double hostSeconds(HostClock::time_point start) {
+    return std::chrono::duration<double>(HostClock::now() - start).count();
+}
+
+void setUp() {
+    NativeSim::reset();
+    for (uint8_t i = 0; i < RELAYS; i++) {
+        NativeSim::setInput(CONTROL_PINS[i], false);
+    }
+    Firmware::boot();
+    Firmware::configureRelays(RELAYS, SET_PINS, MONITOR_PINS, CONTROL_PINS);
+    for (uint8_t i = 0; i < RELAYS; i++) {
+        NativeSim::connect(SET_PINS[i], MONITOR_PINS[i], CONTACT_DELAY_MICROS);
+    }
+    Firmware::runFor(200);
+    NativeSim::serialReceived().clear();
+    Firmware::rounds = 0;
+}
+
+void tearDown() {}
+
+// every control pin toggles every 120 ms with a 40 ms phase shift between relays, for 6 seconds
+void test_input_storm() {
+    const uint32_t period = 120000;
+    const uint32_t duration = 6000000;
+    bool levels[RELAYS] = {};
+    uint32_t edgeTimes[RELAYS] = {};
+    bool pending[RELAYS] = {};
+    uint32_t edges = 0;
+    uint32_t followed = 0;
+    uint32_t maxLatency = 0;
+    uint64_t latencySum = 0;
+    uint32_t start = NativeSim::nowMicros();
+    auto hostStart = HostClock::now();
+    while (NativeSim::nowMicros() - start < duration) {
+        uint32_t now = NativeSim::nowMicros() - start;
+        for (uint8_t i = 0; i < RELAYS; i++) {
+            bool level = ((now + i * 40000) / period) & 1;
+            if (level != levels[i]) {
+                levels[i] = level;
+                NativeSim::setInput(CONTROL_PINS[i], level);
+                edgeTimes[i] = NativeSim::nowMicros();
+                pending[i] = true;
+                edges++;
+            }
+            if (pending[i] && NativeSim::getOutput(SET_PINS[i]) == levels[i]) {
+                uint32_t latency = NativeSim::nowMicros() - edgeTimes[i];
+                maxLatency = latency > maxLatency ? latency : maxLatency;
+                latencySum += latency;
+                pending[i] = false;
+                followed++;
+            }
+        }
+        Firmware::round();
+    }
+    double seconds = duration / 1e6;
+    report("input storm", "%.0f edges, %.0f followed, latency avg %.2f ms max %.2f ms",
+           edges, followed, followed ? latencySum / 1000.0 / followed : 0, maxLatency / 1000.0);
+    report("input storm", "%.0f loop rounds/s, %.0f sleeps, host %.3f s",
+           Firmware::rounds / seconds, NativeSim::stats().sleeps, hostSeconds(hostStart));
+    TEST_ASSERT_GREATER_OR_EQUAL(edges - RELAYS, followed);
+    //contact ready wait plus a few rounds
+    TEST_ASSERT_LESS_OR_EQUAL(DEFAULT_CONTACT_READY_WAIT_DELAY * 1000 + 5000, maxLatency);
+}
+
+// relay state writes sent back to back, the host does not wait for responses
+void test_command_flood() {
+    const uint32_t commands = 500;
+    uint32_t start = NativeSim::nowMicros();
+    auto hostStart = HostClock::now();
+    for (uint32_t id = 1; id <= commands; id++) {
+        uint8_t relayIdx = id % RELAYS;
+        uint8_t switchedOn = (id / RELAYS) & 1;
+        Firmware::sendCommand(IC_SET, IDC_RELAY_STATE, id, {(uint8_t) (relayIdx | (switchedOn << 4))});
+    }
+    uint32_t answered = 0;
+    size_t searchFrom = 0;
+    Firmware::runUntil([&]() {
+        while (answered < commands) {
+            int pos = Firmware::findResponse(IC_SUCCESS, IDC_RELAY_STATE, answered + 1, searchFrom);
+            if (pos < 0) break;
+            searchFrom = pos + 1;
+            answered++;
+        }
+        return answered == commands;
+    }, 60000);
+    double seconds = (NativeSim::nowMicros() - start) / 1e6;
+    double wireLimit = NativeSim::getBaudRate() / 10.0 / Firmware::frame(IC_SET, IDC_RELAY_STATE, 0, {0}).size();
+    report("command flood", "%.0f of %.0f answered, %.1f commands/s (wire limit %.1f)",
+           answered, commands, answered / seconds, wireLimit);
+    report("command flood", "%.0f loop rounds, %.0f RX overruns, host %.0f commands/s",
+           Firmware::rounds, NativeSim::stats().rxOverruns, answered / hostSeconds(hostStart));
+    TEST_ASSERT_EQUAL_UINT32(commands, answered);
+    TEST_ASSERT_EQUAL_UINT32(0, NativeSim::stats().rxOverruns);
+}
+
+// state fix settings rewritten every 50 ms, the commit happens after the changes stop
+void test_settings_rewrites() {
+    const uint32_t rewrites = 200;
+    uint32_t writesBefore = NativeSim::stats().eepromWrites;
+    uint32_t roundsBefore = Firmware::rounds;
+    auto hostStart = HostClock::now();
+    for (uint32_t id = 1; id <= rewrites; id++) {
+        auto delay = (uint16_t) (100 + id);
+        Firmware::sendCommand(IC_SET, IDC_STATE_FIX_SETTINGS, id,
+                              {(uint8_t) (delay >> 8), (uint8_t) delay, 3, 10, 0, 50});
+        Firmware::runFor(50);
+    }
+    uint32_t commitStart = NativeSim::nowMicros();
+    Firmware::runUntil([]() { return !Firmware::settings.isDirty(); }, SETTINGS_COMMIT_DELAY_MILLIS * 3);
+    double commitMillis = (NativeSim::nowMicros() - commitStart) / 1000.0;
+    uint32_t writes = NativeSim::stats().eepromWrites - writesBefore;
+    report("settings rewrites", "%.0f rewrites, %.0f EEPROM byte writes, max %.0f writes of one cell",
+           rewrites, writes, NativeSim::eepromMaxCellWrites());
+    report("settings rewrites", "commit done %.0f ms after the last change, %.0f loop rounds, host %.3f s",
+           commitMillis, Firmware::rounds - roundsBefore, hostSeconds(hostStart));
+    TEST_ASSERT_FALSE(Firmware::settings.isDirty());
+    TEST_ASSERT_LESS_THAN(rewrites, NativeSim::eepromMaxCellWrites());
+    Firmware::boot();
+    TEST_ASSERT_EQUAL_UINT16(100 + rewrites, Firmware::settings.getStateFixSettings().getDelayMillis());
+}
+
+// most writes of one settings slot cell since the counts were taken
+uint32_t maxSlotCellWrites(const std::vector<uint32_t> &before) {
+    uint32_t max = 0;
+    for (uint16_t i = 0; i < before.size(); i++) {
+        uint32_t writes = NativeSim::eepromCellWrites(SETTINGS_SLOTS_LOCATION + i) - before[i];
+        max = writes > max ? writes : max;
+    }
+    return max;
+}
+
+std::vector<uint32_t> slotCellWrites() {
+    std::vector<uint32_t> writes;
+    for (uint16_t i = 0; i < SETTINGS_SLOTS_COUNT * SETTINGS_SLOT_SIZE; i++) {
+        writes.push_back(NativeSim::eepromCellWrites(SETTINGS_SLOTS_LOCATION + i));
+    }
+    return writes;
+}
+
+// host tuning sessions: 8 state fix settings and 2 id changes 100 ms apart, then the host leaves the
+// controller alone and the deferred commit writes the settings once per session
+void test_settings_tuning_sessions() {
+    const uint32_t sessions = 40;
+    std::vector<uint32_t> before = slotCellWrites();
+    uint32_t writesBefore = NativeSim::stats().eepromWrites;
+    uint32_t id = 1;
+    for (uint32_t session = 0; session < sessions; session++) {
+        for (uint8_t i = 0; i < 10; i++, id++) {
+            if (i % 5 == 4) {
+                Firmware::sendCommand(IC_SET, IDC_ID, id,
+                                      {(uint8_t) (id >> 24), (uint8_t) (id >> 16), (uint8_t) (id >> 8), (uint8_t) id});
+            } else {
+                auto delay = (uint16_t) (100 + id);
+                Firmware::sendCommand(IC_SET, IDC_STATE_FIX_SETTINGS, id,
+                                      {(uint8_t) (delay >> 8), (uint8_t) delay, 3, 10, 0, 50});
+            }
+            Firmware::runFor(100);
+        }
+        Firmware::runUntil([]() { return !Firmware::settings.isDirty(); }, SETTINGS_COMMIT_DELAY_MILLIS * 3);
+    }
+    uint32_t saves = id - 1;
+    uint32_t maxWrites = maxSlotCellWrites(before);
+    report("tuning sessions", "%.0f sessions, %.0f saves, %.0f EEPROM byte writes",
+           sessions, saves, NativeSim::stats().eepromWrites - writesBefore);
+    report("tuning sessions", "max %.0f writes of one cell, write-through to fixed cells: %.0f",
+           maxWrites, sessions * 8);
+    //one commit per session, rotated over the slots
+    TEST_ASSERT_LESS_OR_EQUAL((sessions + SETTINGS_SLOTS_COUNT - 1) / SETTINGS_SLOTS_COUNT, maxWrites);
+    Firmware::boot();
+    TEST_ASSERT_EQUAL_UINT32(id - 1, Firmware::settings.getControllerId());
+}
+
+// the worst case: every id change is committed right away with IDC_COMMIT_SETTINGS
+void test_settings_commit_per_change() {
+    const uint32_t changes = 200;
+    std::vector<uint32_t> before = slotCellWrites();
+    for (uint32_t id = 1; id <= changes; id++) {
+        Firmware::sendCommand(IC_SET, IDC_ID, id,
+                              {(uint8_t) (id >> 24), (uint8_t) (id >> 16), (uint8_t) (id >> 8), (uint8_t) id});
+        Firmware::sendCommand(IC_COMMAND, IDC_COMMIT_SETTINGS, id);
+        Firmware::runFor(20);
+        Firmware::runUntil([]() { return !Firmware::settings.isDirty(); }, 1000);
+    }
+    uint32_t maxWrites = maxSlotCellWrites(before);
+    report("commit per change", "%.0f committed changes, max %.0f writes of one cell, write-through: %.0f",
+           changes, maxWrites, changes);
+    TEST_ASSERT_LESS_OR_EQUAL(changes / SETTINGS_SLOTS_COUNT, maxWrites);
+    Firmware::boot();
+    TEST_ASSERT_EQUAL_UINT32(changes, Firmware::settings.getControllerId());
+}
+
+// the monitor contacts of all relays but the last stick on, they are fixed with pulses while the control pin
+// of the last relay toggles every 300 ms, for 8 seconds
+void test_state_fix_pulses() {
+    const uint8_t fixed = RELAYS - 1;
+    const uint32_t period = 300000;
+    const uint32_t duration = 8000000;
+    const uint8_t maxCount = 5;
+    Firmware::settings.saveStateFixSettings(StateFixSettings(DEFAULT_STATE_FIX_DELAY, maxCount, 1,
+                                                             DEFAULT_CONTACT_READY_WAIT_DELAY));
+    Firmware::settings.commit();
+    Firmware::runUntil([]() { return !Firmware::settings.isDirty(); }, 1000);
+    for (uint8_t i = 0; i < fixed; i++) {
+        RelayController::setRelayState(i, false);
+        NativeSim::disconnect(MONITOR_PINS[i]);
+        NativeSim::setInput(MONITOR_PINS[i], true);
+    }
+    const uint8_t controlled = RELAYS - 1;
+    bool level = false;
+    uint32_t edgeTime = 0;
+    bool pending = false;
+    uint32_t edges = 0;
+    uint32_t followed = 0;
+    uint32_t maxLatency = 0;
+    uint32_t maxRound = 0;
+    uint8_t maxPulsing = 0;
+    uint32_t start = NativeSim::nowMicros();
+    auto hostStart = HostClock::now();
+    Firmware::rounds = 0;
+    while (NativeSim::nowMicros() - start < duration) {
+        bool newLevel = ((NativeSim::nowMicros() - start) / period) & 1;
+        if (newLevel != level) {
+            level = newLevel;
+            NativeSim::setInput(CONTROL_PINS[controlled], level);
+            edgeTime = NativeSim::nowMicros();
+            pending = true;
+            edges++;
+        }
+        if (pending && NativeSim::getOutput(SET_PINS[controlled]) == level) {
+            uint32_t latency = NativeSim::nowMicros() - edgeTime;
+            maxLatency = latency > maxLatency ? latency : maxLatency;
+            pending = false;
+            followed++;
+        }
+        //the fixed relays are off, a fix pulse sets their set pin
+        uint8_t pulsing = 0;
+        for (uint8_t i = 0; i < fixed; i++) {
+            pulsing += NativeSim::getOutput(SET_PINS[i]);
+        }
+        maxPulsing = pulsing > maxPulsing ? pulsing : maxPulsing;
+        uint32_t roundStart = NativeSim::nowMicros();
+        Firmware::round();
+        uint32_t round = NativeSim::nowMicros() - roundStart;
+        maxRound = round > maxRound ? round : maxRound;
+    }
+    uint32_t tries = 0;
+    for (uint8_t i = 0; i < fixed; i++) {
+        tries += RelayController::getFixTryCount(i);
+    }
+    report("state fix", "%.0f relays fixed, %.0f fix pulses, up to %.0f pulses at once",
+           fixed, tries, maxPulsing);
+    report("state fix", "longest loop round %.2f ms, control latency max %.2f ms, %.0f of %.0f edges followed",
+           maxRound / 1000.0, maxLatency / 1000.0, followed, edges);
+    report("state fix", "%.0f loop rounds, host %.3f s", Firmware::rounds, hostSeconds(hostStart), 0);
+    TEST_ASSERT_EQUAL_UINT32(fixed * maxCount, tries);
+    TEST_ASSERT_EQUAL_UINT8(fixed, maxPulsing);
+    TEST_ASSERT_GREATER_OR_EQUAL(edges - 1, followed);
+    //a round never waits for a pulse
+    TEST_ASSERT_LESS_THAN(DEFAULT_STATE_FIX_DELAY * 1000 / 10, maxRound);
+    TEST_ASSERT_LESS_OR_EQUAL(DEFAULT_CONTACT_READY_WAIT_DELAY * 1000 + 5000, maxLatency);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_input_storm);
+    RUN_TEST(test_command_flood);
+    RUN_TEST(test_settings_rewrites);
+    RUN_TEST(test_settings_tuning_sessions);
+    RUN_TEST(test_settings_commit_per_change);
+    RUN_TEST(test_state_fix_pulses);
+    return UNITY_END();
+}
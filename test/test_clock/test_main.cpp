@@ -0,0 +1,66 @@
+#include <unity.h>
+#include <stdlib.h>
+#include "NativeSim.h"
+#include "Clock.h"
+#include "utils.h"
+
+void setUp() {
+    NativeSim::reset();
+    Clock::setup();
+}
+
+void tearDown() {}
+
+void test_seconds_follow_millis() {
+    srand(18);
+    for (uint32_t i = 0; i < 100000; i++) {
+        //mostly short rounds, sometimes long stalls
+        uint32_t step = rand() % 20 == 0 ? rand() % 5000000 : rand() % 3000;
+        NativeSim::advanceMicros(step);
+        Clock::update();
+        uint32_t now = millis();
+        TEST_ASSERT_UINT_WITHIN(1, now, Clock::getMillis());
+        TEST_ASSERT_EQUAL_UINT32(Clock::getMillis() / MILLIS_PER_SECOND, Clock::getSec());
+        TEST_ASSERT_EQUAL_UINT16(Clock::getMillis() % MILLIS_PER_SECOND, Clock::getMillisOfSec());
+    }
+}
+
+void test_time_is_fixed_within_round() {
+    Clock::update();
+    uint32_t millisOfRound = Clock::getMillis();
+    uint32_t secOfRound = Clock::getSec();
+    NativeSim::advanceMicros(2500000);
+    TEST_ASSERT_EQUAL_UINT32(millisOfRound, Clock::getMillis());
+    TEST_ASSERT_EQUAL_UINT32(secOfRound, Clock::getSec());
+    Clock::update();
+    TEST_ASSERT_EQUAL_UINT32(secOfRound + 2, Clock::getSec());
+}
+
+void test_seconds_keep_counting_over_millis_wrap() {
+    //a minute before millis() wraps after 49.7 days
+    const uint64_t wrapMillis = 0x100000000ULL;
+    uint64_t target = (wrapMillis - 60000) * 1000;
+    while (target != 0) {
+        uint32_t step = target > 4000000000UL ? 4000000000UL : (uint32_t) target;
+        NativeSim::advanceMicros(step);
+        target -= step;
+    }
+    Clock::setup();
+    uint32_t startSec = Clock::getSec();
+    TEST_ASSERT_EQUAL_UINT32((uint32_t) ((wrapMillis - 60000) / MILLIS_PER_SECOND), startSec);
+    for (uint32_t i = 0; i < 1200; i++) {
+        NativeSim::advanceMicros(100000);
+        Clock::update();
+    }
+    //millis() wrapped, the seconds did not
+    TEST_ASSERT_LESS_THAN(61000, millis());
+    TEST_ASSERT_EQUAL_UINT32(startSec + 120, Clock::getSec());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_seconds_follow_millis);
+    RUN_TEST(test_time_is_fixed_within_round);
+    RUN_TEST(test_seconds_keep_counting_over_millis_wrap);
+    return UNITY_END();
+}
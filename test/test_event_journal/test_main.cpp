@@ -0,0 +1,141 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include "../support/FirmwareHarness.h"
+#include "EventJournal.h"
+
+/*
+ * The journal on the simulated EEPROM: cell wear over many wraps of the slots and the boot scan after
+ * a power loss in the middle of a record, and the host read of a range. A power loss keeps the EEPROM content
+ * and clears everything else.
+ */
+
+void setUp() {
+    NativeSim::reset();
+    EventJournal::setup();
+}
+
+void tearDown() {}
+
+uint32_t eventTime(uint16_t seq) {
+    return 1700000000UL + seq * 7;
+}
+
+// events added one at a time and written out, like switches seconds apart
+void journalEvents(uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t seq = EventJournal::getNextSeq();
+        EventJournal::add((uint8_t) (seq & 0x3f), eventTime(seq));
+        while (EventJournal::getNextSeq() == seq) {
+            EventJournal::idle();
+            NativeSim::advanceMicros(100);
+        }
+    }
+}
+
+void powerCycle() {
+    uint8_t eeprom[E2END + 1];
+    memcpy(eeprom, NativeSim::eepromData(), sizeof eeprom);
+    NativeSim::reset();
+    memcpy(NativeSim::eepromData(), eeprom, sizeof eeprom);
+    EventJournal::setup();
+}
+
+void test_slots_wear_evenly() {
+    const uint16_t events = JOURNAL_RECORDS_COUNT * 10;
+    journalEvents(events);
+    uint32_t min = 0xffffffff;
+    uint32_t max = 0;
+    for (uint16_t slot = 0; slot < JOURNAL_RECORDS_COUNT; slot++) {
+        for (uint8_t i = 0; i < JOURNAL_RECORD_SIZE; i++) {
+            uint32_t writes = NativeSim::eepromCellWrites(JOURNAL_LOCATION + slot * JOURNAL_RECORD_SIZE + i);
+            min = writes < min ? writes : min;
+            max = writes > max ? writes : max;
+        }
+        //the low byte of the sequence changes with every record of the slot
+        TEST_ASSERT_EQUAL_UINT32(events / JOURNAL_RECORDS_COUNT,
+                                 NativeSim::eepromCellWrites(JOURNAL_LOCATION + slot * JOURNAL_RECORD_SIZE + 1));
+    }
+    char line[120];
+    snprintf(line, sizeof line, "%u events over %u slots: %u to %u writes per cell",
+             events, JOURNAL_RECORDS_COUNT, (unsigned) min, (unsigned) max);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_EQUAL_UINT32(events / JOURNAL_RECORDS_COUNT, max);
+}
+
+void test_journal_survives_power_cycle() {
+    journalEvents(20);
+    powerCycle();
+    TEST_ASSERT_EQUAL_UINT16(20, EventJournal::getNextSeq());
+    JournalRecord record;
+    TEST_ASSERT_TRUE(EventJournal::readRecord(19, record));
+    TEST_ASSERT_EQUAL_UINT32(eventTime(19), record.time);
+    journalEvents(1);
+    TEST_ASSERT_TRUE(EventJournal::readRecord(20, record));
+}
+
+void test_record_torn_by_power_loss_is_skipped() {
+    //the power loss comes after 0, 1, 2... of the changed bytes of the record, the CRC is written last
+    const uint16_t events = JOURNAL_RECORDS_COUNT + 8;
+    uint8_t written = 0;
+    for (;; written++) {
+        NativeSim::reset();
+        EventJournal::setup();
+        journalEvents(events);
+        NativeSim::powerLossAfterWrites(written);
+        //every byte of the time differs from the record in the slot
+        EventJournal::add(0x3f, ~eventTime(events));
+        for (uint8_t i = 0; i < JOURNAL_RECORD_SIZE; i++) {
+            EventJournal::idle();
+            NativeSim::advanceMicros(NATIVE_SIM_EEPROM_WRITE_MICROS);
+        }
+        if (!NativeSim::isPowerLost()) {
+            //all changed bytes were written
+            break;
+        }
+        powerCycle();
+        TEST_ASSERT_EQUAL_UINT16(events, EventJournal::getNextSeq());
+        JournalRecord record;
+        TEST_ASSERT_FALSE(EventJournal::readRecord(events, record));
+        //a torn record took the slot of the oldest one, the rest is intact
+        TEST_ASSERT_EQUAL(written == 0, EventJournal::readRecord(events - JOURNAL_RECORDS_COUNT, record));
+        for (uint16_t seq = events - JOURNAL_RECORDS_COUNT + 1; seq < events; seq++) {
+            TEST_ASSERT_TRUE(EventJournal::readRecord(seq, record));
+            TEST_ASSERT_EQUAL_UINT32(eventTime(seq), record.time);
+        }
+        journalEvents(1);
+        TEST_ASSERT_TRUE(EventJournal::readRecord(events, record));
+    }
+    //sequence low byte, state and time changed, the sequence high byte did not
+    TEST_ASSERT_GREATER_OR_EQUAL(6, written);
+}
+
+void test_host_reads_journal_range() {
+    Firmware::boot();
+    journalEvents(5);
+    Firmware::sendCommand(IC_READ, IDC_JOURNAL, 0x66, {0, 2, 3});
+    Firmware::runFor(100);
+    int pos = Firmware::findResponse(IC_RESPONSE, IDC_JOURNAL, 0x66);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pos);
+    const std::vector<uint8_t> &received = NativeSim::serialReceived();
+    //next seq, dropped count, records count
+    const uint8_t head[] = {0, 5, 0, 0, 3};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(head, received.data() + pos + 7, sizeof head);
+    for (uint8_t i = 0; i < 3; i++) {
+        const uint8_t *data = received.data() + pos + 7 + sizeof head + i * 7;
+        uint16_t seq = 2 + i;
+        TEST_ASSERT_EQUAL_UINT16(seq, (data[0] << 8) | data[1]);
+        TEST_ASSERT_EQUAL_UINT8(seq & 0x3f, data[2]);
+        TEST_ASSERT_EQUAL_UINT32(eventTime(seq), ((uint32_t) data[3] << 24) | ((uint32_t) data[4] << 16)
+                                                 | ((uint32_t) data[5] << 8) | data[6]);
+    }
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_slots_wear_evenly);
+    RUN_TEST(test_journal_survives_power_cycle);
+    RUN_TEST(test_record_torn_by_power_loss_is_skipped);
+    RUN_TEST(test_host_reads_journal_range);
+    return UNITY_END();
+}
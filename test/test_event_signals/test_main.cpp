@@ -0,0 +1,76 @@
+#include <unity.h>
+#include "../support/FirmwareHarness.h"
+#include "EventSignals.h"
+
+#define CONTROL_PIN_0 6
+#define CONTROL_PIN_1 8
+
+void setUp() {
+    NativeSim::reset();
+    Firmware::boot();
+    const uint8_t setPins[] = {5, 7};
+    const uint8_t monitorPins[] = {0xff, 0xff};
+    const uint8_t controlPins[] = {CONTROL_PIN_0, CONTROL_PIN_1};
+    Firmware::configureRelays(2, setPins, monitorPins, controlPins);
+    NativeSim::setInput(CONTROL_PIN_0, LOW);
+    NativeSim::setInput(CONTROL_PIN_1, LOW);
+    Firmware::runFor(500);
+    EventSignals::clearMergedCounts();
+    NativeSim::serialReceived().clear();
+}
+
+void tearDown() {}
+
+// relay state signal header and its changed, switched on and internal masks
+std::vector<uint8_t> relayStateSignal(uint16_t changed, uint16_t switchedOn, uint16_t internal) {
+    return {IC_NONE, IC_SIGNAL, IDC_RELAYS_STATE_CHANGED,
+            (uint8_t) (changed >> 8), (uint8_t) changed,
+            (uint8_t) (switchedOn >> 8), (uint8_t) switchedOn,
+            (uint8_t) (internal >> 8), (uint8_t) internal};
+}
+
+void test_chattering_relay_does_not_delay_other_relay() {
+    bool on = true;
+    for (uint8_t i = 0; i < 4; i++, on = !on) {
+        RelayController::setRelayState(0, on);
+        Firmware::runFor(2);
+    }
+    //relay 0 window is open and has pending changes, relay 1 is sent right away
+    RelayController::setRelayState(1, true);
+    Firmware::runFor(20);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find(relayStateSignal(0x0002, 0x0002, 0)));
+    TEST_ASSERT_EQUAL_INT(-1, Firmware::find(relayStateSignal(0x0001, 0, 0)));
+    TEST_ASSERT_GREATER_THAN(0, EventSignals::getMergedCount(0));
+    TEST_ASSERT_EQUAL_UINT8(0, EventSignals::getMergedCount(1));
+    //the merged changes of relay 0 follow when its window ends, with the last state
+    Firmware::runFor(SIGNAL_COALESCE_MILLIS);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find(relayStateSignal(0x0001, 0, 0)));
+}
+
+void test_control_pin_switch_is_signalled_internal() {
+    NativeSim::setInput(CONTROL_PIN_1, HIGH);
+    Firmware::runFor(500);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find(relayStateSignal(0x0002, 0x0002, 0x0002)));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_SIGNAL, IDC_RELAYS_CONTROL_CHANGED,
+                                                    0x00, 0x02, 0x00, 0x02}));
+    RelayController::setRelayState(1, false);
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find(relayStateSignal(0x0002, 0, 0)));
+}
+
+void test_version_is_protocol_version() {
+    Firmware::sendCommand(IC_READ, IDC_VERSION, 0x55);
+    Firmware::runFor(50);
+    int pos = Firmware::findResponse(IC_RESPONSE, IDC_VERSION, 0x55);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pos);
+    TEST_ASSERT_EQUAL_UINT8(PROTOCOL_VERSION, NativeSim::serialReceived()[pos + 7]);
+    TEST_ASSERT_EQUAL_UINT8(4, PROTOCOL_VERSION);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_chattering_relay_does_not_delay_other_relay);
+    RUN_TEST(test_control_pin_switch_is_signalled_internal);
+    RUN_TEST(test_version_is_protocol_version);
+    return UNITY_END();
+}
@@ -0,0 +1,63 @@
+#include <unity.h>
+#include "../support/FirmwareHarness.h"
+
+// control and monitor pins of the relays spread over PORTD, PORTB and PORTC
+#define RELAYS 3
+const uint8_t SET_PINS[RELAYS] = {3, 4, 5};
+const uint8_t MONITOR_PINS[RELAYS] = {7, 10, A4};
+const uint8_t CONTROL_PINS[RELAYS] = {6, 9, A0};
+
+void setUp() {
+    NativeSim::reset();
+    for (uint8_t i = 0; i < RELAYS; i++) {
+        NativeSim::setInput(CONTROL_PINS[i], LOW);
+        NativeSim::setInput(MONITOR_PINS[i], LOW);
+    }
+    Firmware::boot();
+}
+
+void tearDown() {}
+
+void configure(const uint8_t controlPins[RELAYS]) {
+    Firmware::configureRelays(RELAYS, SET_PINS, MONITOR_PINS, controlPins);
+    Firmware::runFor(100);
+}
+
+void test_inputs_of_all_ports_are_sampled_together() {
+    configure(CONTROL_PINS);
+    TEST_ASSERT_EQUAL_HEX16(0, RelayController::getControlStates());
+    for (uint8_t i = 0; i < RELAYS; i++) {
+        NativeSim::setInput(CONTROL_PINS[i], HIGH);
+        NativeSim::setInput(MONITOR_PINS[i], HIGH);
+    }
+    //one round takes all of them from the same snapshot
+    Firmware::round();
+    TEST_ASSERT_EQUAL_HEX16(0x0007, RelayController::getControlStates());
+    TEST_ASSERT_EQUAL_HEX16(0x0007, RelayController::getMonitorStates());
+    NativeSim::setInput(CONTROL_PINS[1], LOW);
+    NativeSim::setInput(MONITOR_PINS[2], LOW);
+    Firmware::round();
+    TEST_ASSERT_EQUAL_HEX16(0x0005, RelayController::getControlStates());
+    TEST_ASSERT_EQUAL_HEX16(0x0003, RelayController::getMonitorStates());
+}
+
+void test_inversed_and_disabled_pins() {
+    const uint8_t controlPins[RELAYS] = {CONTROL_PINS[0], (uint8_t) (CONTROL_PINS[1] | RELAY_INVERSED_BIT_MASK), 0xff};
+    configure(controlPins);
+    TEST_ASSERT_EQUAL_HEX16(0x0002, RelayController::getControlStates());
+    NativeSim::setInput(CONTROL_PINS[0], HIGH);
+    NativeSim::setInput(CONTROL_PINS[1], HIGH);
+    NativeSim::setInput(CONTROL_PINS[2], HIGH);
+    Firmware::round();
+    TEST_ASSERT_EQUAL_HEX16(0x0001, RelayController::getControlStates());
+    for (uint8_t i = 0; i < RELAYS; i++) {
+        TEST_ASSERT_EQUAL(CHECK_BIT(RelayController::getControlStates(), i), RelayController::checkControlPinState(i));
+    }
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_inputs_of_all_ports_are_sampled_together);
+    RUN_TEST(test_inversed_and_disabled_pins);
+    return UNITY_END();
+}
@@ -0,0 +1,244 @@
+#include <unity.h>
+#include "../support/FirmwareHarness.h"
+#include "../support/SwitchHistoryDecoder.h"
+#include "EventSignals.h"
+
+void setUp() {
+    NativeSim::reset();
+    Firmware::boot();
+}
+
+void tearDown() {}
+
+void sendInChunks(const std::vector<uint8_t> &bytes, size_t chunk, uint32_t gapMillis) {
+    for (size_t i = 0; i < bytes.size(); i += chunk) {
+        size_t size = bytes.size() - i < chunk ? bytes.size() - i : chunk;
+        NativeSim::serialSend(bytes.data() + i, size);
+        Firmware::runFor(gapMillis);
+    }
+}
+
+void test_frame_in_chunks_is_executed_once() {
+    uint32_t roundsBefore = Firmware::rounds;
+    sendInChunks(Firmware::frame(IC_READ, IDC_ID, 0x11), 2, 15);
+    Firmware::runFor(20);
+    int pos = Firmware::findResponse(IC_RESPONSE, IDC_ID, 0x11);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pos);
+    TEST_ASSERT_EQUAL_INT(-1, Firmware::findResponse(IC_RESPONSE, IDC_ID, 0x11, pos + 1));
+    //the loop kept running while the frame was incomplete
+    TEST_ASSERT_GREATER_THAN(roundsBefore + 50, Firmware::rounds);
+}
+
+void test_frame_longer_than_rx_buffer() {
+    const uint8_t items = 30;
+    std::vector<uint8_t> args = {0, items};
+    for (uint8_t i = 0; i < items; i++) {
+        args.insert(args.end(), {IC_READ, IDC_ID, 0});
+    }
+    std::vector<uint8_t> frame = Firmware::frame(IC_COMMAND, IDC_BATCH, 0x22, args);
+    TEST_ASSERT_GREATER_THAN(SERIAL_RX_BUFFER_SIZE, frame.size());
+    Firmware::send(frame);
+    TEST_ASSERT_TRUE(Firmware::runUntil([]() { return Firmware::findResponse(IC_RESPONSE, IDC_BATCH, 0x22) >= 0; }, 1000));
+    TEST_ASSERT_EQUAL_UINT32(0, NativeSim::stats().rxOverruns);
+}
+
+void test_corrupt_frame_is_rejected_and_next_frame_accepted() {
+    std::vector<uint8_t> frame = Firmware::frame(IC_SET, IDC_ID, 0x33, {0, 0, 0x12, 0x34});
+    frame.back() ^= 0x5a;
+    Firmware::send(frame);
+    Firmware::sendCommand(IC_READ, IDC_ID, 0x34);
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_FRAME_CRC_MISMATCH}));
+    TEST_ASSERT_EQUAL_INT(-1, Firmware::findResponse(IC_SUCCESS, IDC_ID, 0x33));
+    TEST_ASSERT_NOT_EQUAL(0x1234, Firmware::settings.getControllerId());
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findResponse(IC_RESPONSE, IDC_ID, 0x34));
+}
+
+void test_incomplete_frame_times_out() {
+    std::vector<uint8_t> frame = Firmware::frame(IC_READ, IDC_ID, 0x44);
+    NativeSim::serialSend(frame.data(), frame.size() - 2);
+    Firmware::runFor(MAX_FRAME_BYTE_WAIT_TIME + 20);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_FRAME_INCOMPLETE}));
+    Firmware::sendCommand(IC_READ, IDC_ID, 0x45);
+    Firmware::runFor(50);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findResponse(IC_RESPONSE, IDC_ID, 0x45));
+}
+
+void test_long_command_is_decoded_as_it_arrives() {
+    //unused bytes after the fields are dropped while arriving, nothing is staged
+    std::vector<uint8_t> args = {0x12, 0x34, 0x56, 0x78};
+    args.resize(240, 0xa5);
+    std::vector<uint8_t> frame = Firmware::frame(IC_SET, IDC_ID, 0x55, args);
+    TEST_ASSERT_GREATER_THAN(3 * SERIAL_RX_BUFFER_SIZE, frame.size());
+    sendInChunks(frame, SERIAL_RX_BUFFER_SIZE / 2, 2);
+    TEST_ASSERT_TRUE(Firmware::runUntil([]() { return Firmware::findResponse(IC_SUCCESS, IDC_ID, 0x55) >= 0; }, 500));
+    TEST_ASSERT_EQUAL_HEX32(0x12345678, Firmware::settings.getControllerId());
+    TEST_ASSERT_EQUAL_UINT32(0, NativeSim::stats().rxOverruns);
+}
+
+void test_oversized_batch_is_rejected() {
+    std::vector<uint8_t> args = {0, BATCH_BUFF_SIZE / 4 + 1};
+    for (uint8_t i = 0; i < BATCH_BUFF_SIZE / 4 + 1; i++) {
+        args.insert(args.end(), {IC_SET, IDC_ID, 1, 0});
+    }
+    Firmware::sendCommand(IC_COMMAND, IDC_BATCH, 0x56, args);
+    Firmware::sendCommand(IC_READ, IDC_ID, 0x57);
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_COMMAND_SIZE_OVERFLOW, IDC_BATCH, 0, 0, 0, 0x56}));
+    TEST_ASSERT_EQUAL_INT(-1, Firmware::findResponse(IC_RESPONSE, IDC_BATCH, 0x56));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findResponse(IC_RESPONSE, IDC_ID, 0x57));
+}
+
+void test_corrupt_batch_switches_nothing() {
+    const uint8_t setPins[] = {3};
+    const uint8_t noPins[] = {0xff};
+    Firmware::configureRelays(1, setPins, noPins, noPins);
+    std::vector<uint8_t> args = {0, 2, IC_SET, IDC_RELAY_STATE, 1, 0x10, IC_READ, IDC_ID, 0};
+    std::vector<uint8_t> frame = Firmware::frame(IC_COMMAND, IDC_BATCH, 0x77, args);
+    frame[frame.size() - 2] ^= 0x01;
+    Firmware::send(frame);
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_FRAME_CRC_MISMATCH}));
+    TEST_ASSERT_EQUAL_UINT16(0, RelayController::getRelayStates());
+    Firmware::sendCommand(IC_COMMAND, IDC_BATCH, 0x78, args);
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findResponse(IC_RESPONSE, IDC_BATCH, 0x78));
+    TEST_ASSERT_EQUAL_UINT16(1, RelayController::getRelayStates());
+}
+
+void test_error_ids() {
+    //unknown main code, the id is not read
+    Firmware::sendCommand((InstructionCode) 0x0e, IDC_ID, 0x88);
+    //unknown data code after the id was read
+    Firmware::sendCommand(IC_SET, (InstructionDataCode) 0x7f, 0x89, {0});
+    std::vector<uint8_t> corrupt = Firmware::frame(IC_READ, IDC_ID, 0x8a);
+    corrupt.back() ^= 0xff;
+    Firmware::send(corrupt);
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_INSTRUCTION_UNRECOGIZED, IDC_ID, 0, 0, 0, 0}));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_UNDEFINED_OPERATION, 0x7f, 0, 0, 0, 0x89}));
+    int pos = Firmware::find({IC_NONE, IC_ERROR, E_FRAME_CRC_MISMATCH});
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pos);
+    TEST_ASSERT_EQUAL_UINT32(pos + 3, NativeSim::serialReceived().size());
+}
+
+void test_legacy_command() {
+    Firmware::send({IC_NONE, IC_READ, IDC_ID, 0, 0, 0, 0x66});
+    Firmware::runFor(50);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_RESPONSE, IDC_ID}));
+    TEST_ASSERT_EQUAL_INT(-1, Firmware::findResponse(IC_RESPONSE, IDC_ID, 0x66));
+}
+
+void test_large_responses_never_wait_for_uart() {
+    const uint8_t added = 70;
+    for (uint8_t i = 0; i < added; i++) {
+        SwitchHistory::add(i & 0x1f, 1000 * i, 0, 1000 + i);
+    }
+    TEST_ASSERT_EQUAL_UINT8(added, SwitchHistory::getCount());
+    Scheduler::clearStatistics();
+    std::vector<SwitchEvent> events;
+    uint8_t reads = 0;
+    for (uint32_t id = 1; id < 10; id++) {
+        size_t from = NativeSim::serialReceived().size();
+        Firmware::sendCommand(IC_READ, IDC_SWITCH_DATA, id);
+        Firmware::sendCommand(IC_READ, IDC_FIX_DATA, 0x100 + id);
+        TEST_ASSERT_TRUE(Firmware::runUntil([from, id]() {
+            return Firmware::findResponse(IC_RESPONSE, IDC_FIX_DATA, 0x100 + id, from) >= 0;
+        }, 1000));
+        int pos = Firmware::findResponse(IC_RESPONSE, IDC_SWITCH_DATA, id, from);
+        TEST_ASSERT_GREATER_OR_EQUAL(0, pos);
+        std::vector<uint8_t> &received = NativeSim::serialReceived();
+        int end = Firmware::findResponse(IC_RESPONSE, IDC_FIX_DATA, 0x100 + id, from);
+        size_t before = events.size();
+        uint16_t overflowCount;
+        TEST_ASSERT_TRUE(SwitchHistoryDecoder::decode(received.data() + pos + 7, end - pos - 7, events, overflowCount));
+        if (events.size() == before) {
+            break;
+        }
+        reads++;
+    }
+    //the dump took more than one read, nothing was lost
+    TEST_ASSERT_GREATER_THAN(1, reads);
+    TEST_ASSERT_EQUAL_UINT32(added, events.size());
+    for (uint8_t i = 0; i < added; i++) {
+        TEST_ASSERT_EQUAL_UINT8(i & 0x0f, events[i].relayIdx);
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, TxQueue::getResponseOverflowCount());
+    //a response is never written faster than the UART takes it
+    TEST_ASSERT_LESS_THAN(2000, Scheduler::getMaxRunMicros(ST_SERIAL_RX));
+}
+
+void test_long_batch_response_is_not_split_by_signals() {
+    //telemetry signal every 5 ms
+    Firmware::sendCommand(IC_SET, IDC_TELEMETRY, 1, {1, 0, 5});
+    Firmware::runFor(50);
+    const uint8_t items = 30;
+    std::vector<uint8_t> args = {0, items};
+    for (uint8_t i = 0; i < items; i++) {
+        args.insert(args.end(), {IC_READ, IDC_ID, 0});
+    }
+    Scheduler::clearStatistics();
+    Firmware::sendCommand(IC_COMMAND, IDC_BATCH, 0x99, args);
+    Firmware::runFor(500);
+    uint32_t controllerId = Firmware::settings.getControllerId();
+    std::vector<uint8_t> expected = {IC_NONE, IC_RESPONSE, IDC_BATCH, 0, 0, 0, 0x99, items};
+    for (uint8_t i = 0; i < items; i++) {
+        expected.insert(expected.end(), {IC_NONE, IC_RESPONSE, IDC_ID, (uint8_t) (controllerId >> 24),
+                                         (uint8_t) (controllerId >> 16), (uint8_t) (controllerId >> 8), (uint8_t) controllerId});
+    }
+    expected.push_back(OK);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find(expected));
+    //signals went on after the batch
+    int pos = Firmware::find(expected);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findSignal(IDC_TELEMETRY, pos + expected.size()));
+    TEST_ASSERT_EQUAL_UINT16(0, TxQueue::getResponseOverflowCount());
+    TEST_ASSERT_LESS_THAN(2000, Scheduler::getMaxRunMicros(ST_SERIAL_RX));
+}
+
+void test_atomic_batch_refuses_consuming_read() {
+    EventSignals::clearMergedCounts();
+    //the first change is sent, the second waits for the window end and is merged with the third
+    EventSignals::add(EK_RELAY_STATE, 1, 1);
+    EventSignals::add(EK_RELAY_STATE, 1, 0);
+    EventSignals::add(EK_RELAY_STATE, 1, 1);
+    TEST_ASSERT_EQUAL_UINT8(1, EventSignals::getMergedCount(0));
+    Firmware::sendCommand(IC_COMMAND, IDC_BATCH, 0xa1, {BATCH_ATOMIC_FLAG, 2, IC_READ, IDC_ID, 0,
+                                                        IC_READ, IDC_MERGED_EVENTS, 0});
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findResponse(IC_RESPONSE, IDC_BATCH, 0xa1));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_BATCH_ITEM_NOT_ATOMIC, IDC_MERGED_EVENTS}));
+    TEST_ASSERT_EQUAL_UINT8(1, EventSignals::getMergedCount(0));
+    //a batch, which is not atomic, reads them
+    Firmware::sendCommand(IC_COMMAND, IDC_BATCH, 0xa2, {0, 1, IC_READ, IDC_MERGED_EVENTS, 0});
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::findResponse(IC_RESPONSE, IDC_BATCH, 0xa2));
+    TEST_ASSERT_EQUAL_UINT8(0, EventSignals::getMergedCount(0));
+}
+
+void test_interrupt_pin_is_deprecated() {
+    Firmware::sendCommand(IC_READ, IDC_INTERRUPT_PIN, 0xb1);
+    Firmware::sendCommand(IC_SET, IDC_INTERRUPT_PIN, 0xb2, {3});
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_INSTRUCTION_DEPRECATED, IDC_INTERRUPT_PIN,
+                                                    0, 0, 0, 0xb1}));
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_INSTRUCTION_DEPRECATED, IDC_INTERRUPT_PIN,
+                                                    0, 0, 0, 0xb2}));
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_in_chunks_is_executed_once);
+    RUN_TEST(test_frame_longer_than_rx_buffer);
+    RUN_TEST(test_corrupt_frame_is_rejected_and_next_frame_accepted);
+    RUN_TEST(test_incomplete_frame_times_out);
+    RUN_TEST(test_long_command_is_decoded_as_it_arrives);
+    RUN_TEST(test_oversized_batch_is_rejected);
+    RUN_TEST(test_corrupt_batch_switches_nothing);
+    RUN_TEST(test_error_ids);
+    RUN_TEST(test_legacy_command);
+    RUN_TEST(test_large_responses_never_wait_for_uart);
+    RUN_TEST(test_long_batch_response_is_not_split_by_signals);
+    RUN_TEST(test_atomic_batch_refuses_consuming_read);
+    RUN_TEST(test_interrupt_pin_is_deprecated);
+    return UNITY_END();
+}
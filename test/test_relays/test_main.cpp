@@ -0,0 +1,88 @@
+#include <unity.h>
+#include "../support/FirmwareHarness.h"
+
+#define SET_PIN 5
+#define CONTROL_PIN 6
+
+void setUp() {
+    NativeSim::reset();
+    Firmware::boot();
+    const uint8_t setPins[] = {SET_PIN};
+    const uint8_t monitorPins[] = {0xff};
+    const uint8_t controlPins[] = {CONTROL_PIN};
+    Firmware::configureRelays(1, setPins, monitorPins, controlPins);
+    NativeSim::setInput(CONTROL_PIN, LOW);
+    Firmware::runFor(500);
+}
+
+void tearDown() {}
+
+bool isRelayOn() {
+    return RelayController::getRelayStates() & 1;
+}
+
+void test_control_pin_switches_relay() {
+    TEST_ASSERT_FALSE(isRelayOn());
+    NativeSim::setInput(CONTROL_PIN, HIGH);
+    Firmware::runFor(500);
+    TEST_ASSERT_TRUE(isRelayOn());
+    NativeSim::setInput(CONTROL_PIN, LOW);
+    Firmware::runFor(500);
+    TEST_ASSERT_FALSE(isRelayOn());
+}
+
+void test_change_while_disabled_is_applied_on_enable() {
+    RelayController::setControlTemporaryDisabled(0, true);
+    NativeSim::setInput(CONTROL_PIN, HIGH);
+    Firmware::runFor(500);
+    TEST_ASSERT_FALSE(isRelayOn());
+    RelayController::setControlTemporaryDisabled(0, false);
+    Firmware::runFor(500);
+    TEST_ASSERT_TRUE(isRelayOn());
+}
+
+void test_contact_wait_ended_while_disabled_is_applied_on_enable() {
+    NativeSim::setInput(CONTROL_PIN, HIGH);
+    Firmware::runFor(1);
+    RelayController::setControlTemporaryDisabled(0, true);
+    Firmware::runFor(500);
+    TEST_ASSERT_FALSE(isRelayOn());
+    RelayController::setControlTemporaryDisabled(0, false);
+    Firmware::runFor(10);
+    TEST_ASSERT_TRUE(isRelayOn());
+}
+
+void test_limited_switch_is_applied_when_bucket_has_room() {
+    Firmware::settings.saveSwitchCountingSettings(0, SwitchCountingSettings(10, 2));
+    Firmware::runUntil([]() { return !Firmware::settings.isDirty(); }, 1000);
+    for (uint8_t i = 0; i < 3; i++) {
+        NativeSim::setInput(CONTROL_PIN, i % 2 == 0 ? HIGH : LOW);
+        Firmware::runFor(500);
+    }
+    //the third switch is refused until one switch worth of the interval has passed
+    TEST_ASSERT_FALSE(isRelayOn());
+    Firmware::runFor(5000);
+    TEST_ASSERT_TRUE(isRelayOn());
+}
+
+void test_saved_pin_above_a5_is_disabled() {
+    //pin 25 fits the pin bits, but is not on any port
+    const uint8_t setPins[] = {25};
+    const uint8_t monitorPins[] = {0xff};
+    const uint8_t controlPins[] = {CONTROL_PIN};
+    Firmware::configureRelays(1, setPins, monitorPins, controlPins);
+    TEST_ASSERT_FALSE(Firmware::settings.getRelaySettingsRef(0).getSetPinSettings().isEnabled());
+    NativeSim::setInput(CONTROL_PIN, HIGH);
+    Firmware::runFor(500);
+    TEST_ASSERT_FALSE(isRelayOn());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_control_pin_switches_relay);
+    RUN_TEST(test_change_while_disabled_is_applied_on_enable);
+    RUN_TEST(test_contact_wait_ended_while_disabled_is_applied_on_enable);
+    RUN_TEST(test_limited_switch_is_applied_when_bucket_has_room);
+    RUN_TEST(test_saved_pin_above_a5_is_disabled);
+    return UNITY_END();
+}
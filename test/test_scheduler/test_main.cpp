@@ -0,0 +1,65 @@
+#include <unity.h>
+#include "NativeSim.h"
+#include "Scheduler.h"
+#include "Clock.h"
+
+uint32_t taskMicros[ST_COUNT];
+bool taskWorked;
+
+template<uint8_t TASK>
+bool timedTask() {
+    NativeSim::advanceMicros(taskMicros[TASK]);
+    return taskWorked;
+}
+
+void setUp() {
+    NativeSim::reset();
+    Clock::setup();
+    Scheduler::setTask(ST_INPUTS, timedTask<ST_INPUTS>);
+    Scheduler::setTask(ST_SERIAL_RX, timedTask<ST_SERIAL_RX>);
+    Scheduler::setTask(ST_SERIAL_TX, timedTask<ST_SERIAL_TX>);
+    Scheduler::setTask(ST_MAINTENANCE, timedTask<ST_MAINTENANCE>);
+    Scheduler::clearStatistics();
+    for (uint32_t &micros : taskMicros) {
+        micros = 0;
+    }
+    taskWorked = true;
+}
+
+void tearDown() {}
+
+void test_run_time_is_measured_per_task() {
+    taskMicros[ST_INPUTS] = 100;
+    taskMicros[ST_SERIAL_RX] = 2000;
+    taskMicros[ST_MAINTENANCE] = 40;
+    Scheduler::run();
+    //one micros() call of the scheduler itself may fall into the task
+    TEST_ASSERT_UINT_WITHIN(2, 100, Scheduler::getMaxRunMicros(ST_INPUTS));
+    TEST_ASSERT_UINT_WITHIN(2, 2000, Scheduler::getMaxRunMicros(ST_SERIAL_RX));
+    TEST_ASSERT_UINT_WITHIN(2, 0, Scheduler::getMaxRunMicros(ST_SERIAL_TX));
+    TEST_ASSERT_UINT_WITHIN(2, 40, Scheduler::getMaxRunMicros(ST_MAINTENANCE));
+    TEST_ASSERT_EQUAL_UINT16(1, Scheduler::getRunCount(ST_INPUTS));
+}
+
+void test_long_run_saturates() {
+    taskMicros[ST_SERIAL_RX] = 70000;
+    Scheduler::run();
+    taskMicros[ST_SERIAL_RX] = 1000;
+    Scheduler::run();
+    TEST_ASSERT_EQUAL_UINT16(0xffff, Scheduler::getMaxRunMicros(ST_SERIAL_RX));
+}
+
+void test_idle_round_sleeps() {
+    taskWorked = false;
+    Scheduler::run();
+    TEST_ASSERT_EQUAL_UINT16(1, Scheduler::getSleepCount());
+    TEST_ASSERT_EQUAL_UINT32(1, NativeSim::stats().sleeps);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_run_time_is_measured_per_task);
+    RUN_TEST(test_long_run_saturates);
+    RUN_TEST(test_idle_round_sleeps);
+    return UNITY_END();
+}
@@ -0,0 +1,39 @@
+#include <unity.h>
+#include <string.h>
+#include "../support/FirmwareHarness.h"
+
+void setUp() {
+    NativeSim::reset();
+}
+
+void tearDown() {}
+
+// EEPROM of the legacy firmware: fixed offsets, no settings slots
+void writeLegacyLayout() {
+    uint8_t *eeprom = NativeSim::eepromData();
+    eeprom[RELAYS_COUNT_LOCATION] = 1;
+    const uint32_t id = 0x01020304;
+    memcpy(eeprom + CONTROLLER_ID_LOCATION, &id, sizeof id);
+    const RelaySettings relay(5, RELAY_DISABLED_PIN, 6);
+    memcpy(eeprom + RELAYS_SETTINGS_START_LOCATION, &relay, sizeof relay);
+}
+
+void test_legacy_settings_are_loaded_without_scenes() {
+    writeLegacyLayout();
+    //left over bytes where scenes are kept now
+    memset(NativeSim::eepromData() + SCENES_LOCATION, 0x5a, MAX_SCENES_COUNT * sizeof (RelayScene));
+    Firmware::boot();
+    TEST_ASSERT_EQUAL_UINT8(1, Firmware::settings.getRelaysCount());
+    TEST_ASSERT_EQUAL_HEX32(0x01020304, Firmware::settings.getControllerId());
+    TEST_ASSERT_EQUAL_UINT8(5, Firmware::settings.getRelaySettingsRef(0).getSetPinSettings().getPin());
+    for (uint8_t i = 0; i < MAX_SCENES_COUNT; i++) {
+        TEST_ASSERT_EQUAL_HEX16(0, Firmware::settings.getSceneRef(i).getMask());
+        TEST_ASSERT_EQUAL_HEX16(0, Firmware::settings.getSceneRef(i).getSwitchedOn());
+    }
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_legacy_settings_are_loaded_without_scenes);
+    return UNITY_END();
+}
@@ -0,0 +1,143 @@
+#include <unity.h>
+#include "../support/FirmwareHarness.h"
+#include "StaticRelays.h"
+
+/*
+ * STATIC_RELAYS build with the wiring of StaticRelaysConfig.h, run by the native_static env. The compile time
+ * masks are checked against the PinSettings checks of the EEPROM configured build and the relays are switched
+ * through the unrolled pin reader and writer.
+ */
+#ifndef STATIC_RELAYS
+#error "test_static_relays needs the STATIC_RELAYS build: pio test -e native_static"
+#endif
+
+uint8_t pinOf(uint8_t relayIdx, uint8_t kind) {
+    return STATIC_RELAYS_TABLE[relayIdx][kind] & RELAY_PIN_BITS_MASK;
+}
+
+// the control pin driven to its active or inactive level
+void setControl(uint8_t relayIdx, bool active) {
+    NativeSim::setInput(pinOf(relayIdx, STATIC_CONTROL_PIN), active != isStaticPinInversed(relayIdx, STATIC_CONTROL_PIN));
+}
+
+void setMonitor(uint8_t relayIdx, bool on) {
+    NativeSim::setInput(pinOf(relayIdx, STATIC_MONITOR_PIN), on != isStaticPinInversed(relayIdx, STATIC_MONITOR_PIN));
+}
+
+bool isSetPinOn(uint8_t relayIdx) {
+    return NativeSim::getOutput(pinOf(relayIdx, STATIC_SET_PIN)) != isStaticPinInversed(relayIdx, STATIC_SET_PIN);
+}
+
+bool isSwitchByPush(uint8_t relayIdx) {
+    return STATIC_RELAYS_TABLE[relayIdx][STATIC_CONTROL_PIN] & RELAY_SWITCH_BY_PUSH_BIT_MASK;
+}
+
+void setUp() {
+    NativeSim::reset();
+    for (uint8_t i = 0; i < STATIC_RELAYS_COUNT; i++) {
+        setControl(i, false);
+    }
+    Firmware::boot();
+    Firmware::runFor(200);
+}
+
+void tearDown() {}
+
+void test_static_masks_match_pin_settings() {
+    uint16_t setPins = 0;
+    uint16_t monitorPins = 0;
+    uint16_t controlPins = 0;
+    for (uint8_t i = 0; i < STATIC_RELAYS_COUNT; i++) {
+        const RelaySettings &relay = Firmware::settings.getRelaySettingsRef(i);
+        const PinSettings pins[3] = {relay.getSetPinSettings(), relay.getMonitorPinSettings(),
+                                     relay.getControlPinSettings()};
+        for (uint8_t kind = 0; kind < 3; kind++) {
+            TEST_ASSERT_EQUAL_HEX8(STATIC_RELAYS_TABLE[i][kind], pins[kind].getRaw());
+            bool usable = pins[kind].sanitized().isEnabled();
+            TEST_ASSERT_EQUAL(usable, isStaticPinUsable(i, kind));
+            TEST_ASSERT_EQUAL(pins[kind].isInversed(), isStaticPinInversed(i, kind));
+        }
+        TEST_ASSERT_EQUAL(pins[2].sanitized().isEnabled() && relay.isControlPinSwitchByPush(),
+                          CHECK_BIT(STATIC_SWITCH_BY_PUSH, i));
+        setPins |= pins[0].sanitized().isEnabled() ? 1 << i : 0;
+        monitorPins |= pins[1].sanitized().isEnabled() ? 1 << i : 0;
+        controlPins |= pins[2].sanitized().isEnabled() ? 1 << i : 0;
+    }
+    TEST_ASSERT_EQUAL_UINT8(STATIC_RELAYS_COUNT, Firmware::settings.getRelaysCount());
+    TEST_ASSERT_EQUAL_HEX16(setPins & controlPins, STATIC_CONTROLLED_RELAYS);
+    TEST_ASSERT_EQUAL_HEX16(setPins & monitorPins, STATIC_FIXABLE_RELAYS);
+}
+
+// the control pin switches by level, or toggles the relay on a push
+void switchByControl(uint8_t relayIdx) {
+    setControl(relayIdx, !CHECK_BIT(RelayController::getControlStates(), relayIdx));
+    Firmware::runFor(200);
+    if (isSwitchByPush(relayIdx)) {
+        setControl(relayIdx, false);
+        Firmware::runFor(200);
+    }
+}
+
+void test_control_pins_switch_relays() {
+    for (uint8_t i = 0; i < STATIC_RELAYS_COUNT; i++) {
+        if (!CHECK_BIT(STATIC_CONTROLLED_RELAYS, i)) {
+            continue;
+        }
+        switchByControl(i);
+        TEST_ASSERT_TRUE(CHECK_BIT(RelayController::getRelayStates(), i));
+        TEST_ASSERT_TRUE(isSetPinOn(i));
+        //the other relays keep their state
+        for (uint8_t j = i + 1; j < STATIC_RELAYS_COUNT; j++) {
+            TEST_ASSERT_FALSE(CHECK_BIT(RelayController::getRelayStates(), j));
+        }
+        switchByControl(i);
+        TEST_ASSERT_FALSE(CHECK_BIT(RelayController::getRelayStates(), i));
+        TEST_ASSERT_FALSE(isSetPinOn(i));
+    }
+}
+
+void test_relay_states_drive_static_pins() {
+    const uint16_t switchedOn = 0x0005 & STATIC_SET_PINS;
+    RelayController::setRelayStates(0xffff, switchedOn);
+    TEST_ASSERT_EQUAL_HEX16(switchedOn, RelayController::getRelayStates());
+    for (uint8_t i = 0; i < STATIC_RELAYS_COUNT; i++) {
+        if (CHECK_BIT(STATIC_SET_PINS, i)) {
+            TEST_ASSERT_EQUAL(CHECK_BIT(switchedOn, i), isSetPinOn(i));
+        }
+    }
+    RelayController::setRelayStates(switchedOn, 0);
+    TEST_ASSERT_EQUAL_HEX16(0, RelayController::getRelayStates());
+}
+
+void test_state_fix_pulses_static_set_pin() {
+    uint8_t relayIdx = 0;
+    while (!CHECK_BIT(STATIC_FIXABLE_RELAYS, relayIdx)) {
+        relayIdx++;
+    }
+    setMonitor(relayIdx, false);
+    RelayController::setRelayState(relayIdx, true);
+    //the monitor pin does not follow, so the set pin is pulsed off and on again
+    TEST_ASSERT_TRUE(Firmware::runUntil([relayIdx]() { return !isSetPinOn(relayIdx); },
+                                        (DEFAULT_STATE_FIX_WAIT_DELAY + 1) * MILLIS_PER_SECOND));
+    Firmware::runFor(DEFAULT_STATE_FIX_DELAY + 10);
+    TEST_ASSERT_TRUE(isSetPinOn(relayIdx));
+    TEST_ASSERT_EQUAL_UINT8(1, RelayController::getFixTryCount(relayIdx));
+}
+
+void test_settings_write_is_refused() {
+    Firmware::sendCommand(IC_SET, IDC_SETTINGS, 0x77, {1, 0x05, 0x27, 0x26});
+    Firmware::runFor(100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, Firmware::find({IC_NONE, IC_ERROR, E_UNDEFINED_OPERATION, IDC_SETTINGS,
+                                                    0, 0, 0, 0x77}));
+    TEST_ASSERT_EQUAL_HEX8(STATIC_RELAYS_TABLE[0][0], Firmware::settings.getRelaySettingsRef(0).getSetPinSettings().getRaw());
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_static_masks_match_pin_settings);
+    RUN_TEST(test_control_pins_switch_relays);
+    RUN_TEST(test_relay_states_drive_static_pins);
+    RUN_TEST(test_state_fix_pulses_static_set_pin);
+    RUN_TEST(test_settings_write_is_refused);
+    return UNITY_END();
+}
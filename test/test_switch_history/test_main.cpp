@@ -0,0 +1,174 @@
+#include <unity.h>
+#include <random>
+#include "../support/FirmwareHarness.h"
+#include "../support/SwitchHistoryDecoder.h"
+
+#define REMOTE_START_SEC 1700000000UL
+
+void setUp() {
+    SwitchHistory::clear();
+    SwitchHistory::setPolicy(RBP_DROP_NEWEST);
+}
+
+void tearDown() {}
+
+// the history is dumped the way IDC_SWITCH_DATA does it
+std::vector<uint8_t> dump() {
+    std::vector<uint8_t> data;
+    uint8_t count = SwitchHistory::getCount();
+    data.push_back(count);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t size = SwitchHistory::getEntrySize();
+        for (uint8_t j = 0; j < size; j++) {
+            data.push_back(SwitchHistory::getEntryByte(j));
+        }
+        SwitchHistory::dropEntry(size);
+    }
+    uint16_t overflowCount = SwitchHistory::getOverflowCount();
+    data.push_back(overflowCount >> 8);
+    data.push_back(overflowCount);
+    return data;
+}
+
+// millis() and the remote time running with it
+struct EventTime {
+    uint32_t millis;
+    uint64_t remoteMillis;
+};
+
+// random events with quick bursts, same millisecond switches and long pauses
+std::vector<SwitchEvent> addRandomEvents(std::mt19937 &random, uint32_t count, EventTime &time) {
+    std::vector<SwitchEvent> events;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t gap;
+        switch (random() % 5) {
+            case 0:
+                gap = 0;
+                break;
+            case 1:
+                gap = random() % 100;
+                break;
+            case 2:
+                gap = random() % 20000;
+                break;
+            case 3:
+                gap = random() % (SWITCH_HISTORY_MAX_DELTA_MILLIS + 1);
+                break;
+            default:
+                gap = random() % 10000000;
+        }
+        time.millis += gap;
+        time.remoteMillis += gap;
+        uint8_t state = random() & (SWITCH_HISTORY_RELAY_MASK | SWITCH_HISTORY_ON_FLAG | SWITCH_HISTORY_INTERNAL_FLAG);
+        SwitchHistory::add(state, time.millis, time.remoteMillis % 1000, time.remoteMillis / 1000);
+        events.push_back({(uint8_t) (state & SWITCH_HISTORY_RELAY_MASK), (state & SWITCH_HISTORY_ON_FLAG) != 0,
+                          (state & SWITCH_HISTORY_INTERNAL_FLAG) != 0, time.remoteMillis});
+    }
+    return events;
+}
+
+void checkDump(const std::vector<SwitchEvent> &expected, uint16_t expectedOverflowCount) {
+    std::vector<uint8_t> data = dump();
+    std::vector<SwitchEvent> events;
+    uint16_t overflowCount = 0xffff;
+    TEST_ASSERT_TRUE(SwitchHistoryDecoder::decode(data.data(), data.size(), events, overflowCount));
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        TEST_ASSERT_TRUE(expected[i] == events[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(expectedOverflowCount, overflowCount);
+}
+
+void test_round_trip_of_random_streams() {
+    std::mt19937 random(1);
+    //millis() wraps on the way
+    EventTime time = {0xfff00000, (uint64_t) REMOTE_START_SEC * 1000};
+    for (uint32_t run = 0; run < 2000; run++) {
+        std::vector<SwitchEvent> events = addRandomEvents(random, random() % 40, time);
+        uint16_t overflowCount = SwitchHistory::getOverflowCount();
+        //dropped newest events are only counted
+        events.resize(SwitchHistory::getCount());
+        checkDump(events, overflowCount);
+    }
+}
+
+void test_round_trip_with_overwritten_oldest() {
+    std::mt19937 random(2);
+    EventTime time = {0, (uint64_t) REMOTE_START_SEC * 1000};
+    SwitchHistory::setPolicy(RBP_OVERWRITE_OLDEST);
+    for (uint32_t run = 0; run < 200; run++) {
+        std::vector<SwitchEvent> events = addRandomEvents(random, 50 + random() % 300, time);
+        uint8_t count = SwitchHistory::getCount();
+        uint16_t overflowCount = SwitchHistory::getOverflowCount();
+        TEST_ASSERT_EQUAL_UINT32(events.size(), count + overflowCount);
+        //the newest events are kept, the dump starts with a keyframe
+        checkDump(std::vector<SwitchEvent>(events.end() - count, events.end()), overflowCount);
+        SwitchHistory::clear();
+    }
+}
+
+// events kept until the first one is dropped, with the given gaps between them
+uint8_t countRetained(uint32_t minGapMillis, uint32_t maxGapMillis) {
+    std::mt19937 random(3);
+    uint32_t millis = 0;
+    while (SwitchHistory::getOverflowCount() == 0) {
+        millis += minGapMillis + random() % (maxGapMillis - minGapMillis + 1);
+        SwitchHistory::add(random() & 0x1f, millis, millis % 1000, millis / 1000);
+    }
+    uint8_t count = SwitchHistory::getCount();
+    SwitchHistory::clear();
+    return count;
+}
+
+//the fixed records used before took 5 bytes (state and u32 seconds), 50 of them fit the same RAM
+void test_more_events_than_fixed_size_records() {
+    //seconds apart: 3 bytes per entry and a 7 byte keyframe every 16 entries
+    TEST_ASSERT_GREATER_OR_EQUAL(75, countRetained(500, 5500));
+    //grouped scene switches: 1 byte per entry
+    TEST_ASSERT_GREATER_OR_EQUAL(175, countRetained(0, 0));
+}
+
+void test_firmware_dump_decodes() {
+    NativeSim::reset();
+    Firmware::boot();
+    const uint8_t setPins[] = {5, 7};
+    const uint8_t monitorPins[] = {0xff, 0xff};
+    const uint8_t controlPins[] = {0xff, 0xff};
+    Firmware::configureRelays(2, setPins, monitorPins, controlPins);
+    Firmware::sendCommand(IC_READ, IDC_SWITCH_DATA, 1);
+    Firmware::runFor(100);
+    NativeSim::serialReceived().clear();
+    Firmware::sendCommand(IC_SET, IDC_RELAY_STATE, 2, {0x10});
+    Firmware::runFor(30);
+    Firmware::sendCommand(IC_SET, IDC_RELAY_STATE, 3, {0x11});
+    Firmware::runFor(1234);
+    Firmware::sendCommand(IC_SET, IDC_RELAY_STATE, 4, {0x00});
+    Firmware::runFor(100);
+    Firmware::sendCommand(IC_READ, IDC_SWITCH_DATA, 5);
+    Firmware::runFor(100);
+    int pos = Firmware::findResponse(IC_RESPONSE, IDC_SWITCH_DATA, 5);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, pos);
+    std::vector<uint8_t> &received = NativeSim::serialReceived();
+    std::vector<SwitchEvent> events;
+    uint16_t overflowCount;
+    TEST_ASSERT_TRUE(SwitchHistoryDecoder::decode(received.data() + pos + 7, received.size() - pos - 7,
+                                                  events, overflowCount));
+    TEST_ASSERT_EQUAL_UINT32(3, events.size());
+    TEST_ASSERT_EQUAL_UINT8(0, events[0].relayIdx);
+    TEST_ASSERT_TRUE(events[0].switchedOn);
+    TEST_ASSERT_EQUAL_UINT8(1, events[1].relayIdx);
+    TEST_ASSERT_TRUE(events[1].switchedOn);
+    TEST_ASSERT_EQUAL_UINT8(0, events[2].relayIdx);
+    TEST_ASSERT_FALSE(events[2].switchedOn);
+    TEST_ASSERT_UINT_WITHIN(5, 1234, events[2].timeMillis - events[1].timeMillis);
+    TEST_ASSERT_EQUAL_UINT16(0, overflowCount);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_of_random_streams);
+    RUN_TEST(test_round_trip_with_overwritten_oldest);
+    RUN_TEST(test_more_events_than_fixed_size_records);
+    RUN_TEST(test_firmware_dump_decodes);
+    return UNITY_END();
+}
@@ -0,0 +1,90 @@
+#include <unity.h>
+#include <random>
+#include "SwitchLimiter.h"
+
+/*
+ * Reference token bucket in 64 bit time without overflow: the bucket holds up to the whole interval of credit,
+ * refills one milli per milli and every switch takes one emission interval of it.
+ */
+struct ReferenceBucket {
+    uint64_t credit;
+    uint64_t lastMillis;
+
+    ReferenceBucket(const SwitchCountingSettings &limit, uint64_t now) :
+            credit((uint64_t) MILLIS_PER_SECOND * limit.getSwitchLimitIntervalSec()), lastMillis(now) {}
+
+    bool tryAdd(const SwitchCountingSettings &limit, uint64_t now) {
+        uint64_t intervalMillis = (uint64_t) MILLIS_PER_SECOND * limit.getSwitchLimitIntervalSec();
+        credit += now - lastMillis;
+        if (credit > intervalMillis) {
+            credit = intervalMillis;
+        }
+        lastMillis = now;
+        if (limit.getMaxSwitchCount() == 0 || intervalMillis == 0) {
+            return true;
+        }
+        uint64_t emissionMillis = intervalMillis / limit.getMaxSwitchCount();
+        if (credit < emissionMillis) {
+            return false;
+        }
+        credit -= emissionMillis;
+        return true;
+    }
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+void checkAgainstReference(const SwitchCountingSettings &limit, uint64_t start, uint32_t seed) {
+    std::mt19937 random(seed);
+    uint32_t maxGapMillis = (uint32_t) MILLIS_PER_SECOND * limit.getSwitchLimitIntervalSec() / 2 + 10;
+    SwitchLimiter limiter;
+    limiter.clear((uint32_t) start);
+    ReferenceBucket reference(limit, start);
+    uint64_t now = start;
+    uint32_t refused = 0;
+    for (uint32_t i = 0; i < 200000; i++) {
+        //bursts of quick switches and pauses
+        now += random() % 4 == 0 ? random() % maxGapMillis : random() % 50;
+        uint32_t waitMillis = limiter.getWaitMillis(limit, (uint32_t) now);
+        bool allowed = waitMillis == 0;
+        TEST_ASSERT_EQUAL(reference.tryAdd(limit, now), allowed);
+        if (allowed) {
+            limiter.add(limit, (uint32_t) now);
+        } else {
+            refused++;
+            //allowed exactly when the wait is over
+            TEST_ASSERT_NOT_EQUAL(0, limiter.getWaitMillis(limit, (uint32_t) (now + waitMillis - 1)));
+            TEST_ASSERT_EQUAL_UINT32(0, limiter.getWaitMillis(limit, (uint32_t) (now + waitMillis)));
+        }
+    }
+    if (limit.getMaxSwitchCount() != 0 && limit.getSwitchLimitIntervalSec() != 0) {
+        TEST_ASSERT_GREATER_THAN(0, refused);
+    }
+}
+
+void test_matches_reference() {
+    checkAgainstReference(SwitchCountingSettings(10, 3), 0, 1);
+    checkAgainstReference(SwitchCountingSettings(1, 1), 5, 2);
+    checkAgainstReference(SwitchCountingSettings(60, 40), 0, 3);
+    checkAgainstReference(SwitchCountingSettings(3600, 7), 0, 4);
+}
+
+void test_matches_reference_over_millis_overflow() {
+    checkAgainstReference(SwitchCountingSettings(10, 3), 0xffffffffull - 5000, 5);
+    checkAgainstReference(SwitchCountingSettings(2, 5), 0xffffffffull - 100000, 6);
+}
+
+void test_no_limit() {
+    checkAgainstReference(SwitchCountingSettings(10, 0), 0, 7);
+    checkAgainstReference(SwitchCountingSettings(0, 3), 0, 8);
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_reference);
+    RUN_TEST(test_matches_reference_over_millis_overflow);
+    RUN_TEST(test_no_limit);
+    return UNITY_END();
+}